@@ -52,3 +52,27 @@ D_ATTRIBUTE_FORMAT(2, 0) void vmessage(const Loc& loc, const char *format, va_li
 // Called after printing out fatal error messages.
 D_ATTRIBUTE_NORETURN void fatal();
 D_ATTRIBUTE_NORETURN void halt();
+
+#if IN_LLVM
+// The diagnostics of a thread which must neither print them nor touch the
+// global error counts, see dmd/errors.d.
+struct CollectedDiagnostics
+{
+    char *text;     // the formatted messages (malloc'ed), or null
+    size_t length;
+    unsigned errors;
+    unsigned warnings;
+
+    // Called by fatal() in the collecting thread, must not return.
+    void (*onFatal)(CollectedDiagnostics *);
+    void *context;  // for onFatal
+};
+
+// Makes the current thread collect its diagnostics in `sink`, or report them
+// again if null.
+void collectDiagnostics(CollectedDiagnostics *sink);
+// Prints the collected diagnostics, adds their counts to the global ones and
+// clears them. Main thread only, unless the current thread collects its
+// diagnostics too, which then takes them over.
+void reportCollectedDiagnostics(CollectedDiagnostics &diagnostics);
+#endif
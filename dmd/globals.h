@@ -252,6 +252,9 @@ struct Param
     uint32_t hashThreshold; // MD5 hash symbols larger than this threshold (0 = no hashing)
 
     bool outputSourceLocations; // if true, output line tables.
+
+    bool ctfeBytecode; // run CTFE on the bytecode VM where possible
+    bool ctfeRegion;   // allocate CTFE values from a region released after each evaluation
 #endif
 };
 
@@ -168,6 +168,7 @@ public:
 
     bool llvmForceLogging;
     bool noModuleInfo; /// Do not emit any module metadata.
+    bool isSourceParsed; /// Set by the parallel parsing of the root modules.
 
     // Coverage analysis
     llvm::GlobalVariable* d_cover_valid;  // private immutable size_t[] _d_cover_valid;
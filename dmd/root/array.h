@@ -44,6 +44,13 @@ struct Array
         allocdim = SMALLARRAYCAP;
     }
 
+#if IN_LLVM
+    // Allocate the arrays created by C++ code like the ones created by D code,
+    // i.e., from the GC heap with -lowmem, so that the GC sees their data.
+    static void *operator new(size_t size) { return mem.xmalloc(size); }
+    static void operator delete(void *p) { mem.xfree(p); }
+#endif
+
     ~Array()
     {
         if (data != &smallarray[0])
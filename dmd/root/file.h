@@ -18,7 +18,7 @@ typedef Array<struct File *> Files;
 
 struct File
 {
-    int ref;                    // != 0 if this is a reference to someone else's buffer
+    int ref;                    // != 0 if this is a reference to someone else's buffer (2: a mapping of the file)
     unsigned char *buffer;      // data for our file
     size_t len;                 // amount of data in buffer[]
 
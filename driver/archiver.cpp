@@ -7,20 +7,33 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "driver/archiver.h"
+
 #include "dmd/errors.h"
 #include "dmd/globals.h"
 #include "driver/cl_options.h"
 #include "driver/tool.h"
 #include "gen/logger.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ArchiveWriter.h"
 #include "llvm/Object/MachO.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolicFile.h"
 #include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <mutex>
+#include <thread>
 
 #if LDC_LLVM_VER >= 500
 #include "llvm/ToolDrivers/llvm-lib/LibDriver.h"
@@ -30,6 +43,21 @@
 
 using namespace llvm;
 
+static llvm::cl::opt<std::string> ar("ar", llvm::cl::desc("Archiver"),
+                                     llvm::cl::Hidden, llvm::cl::ZeroOrMore);
+
+static llvm::cl::opt<bool> thinLib(
+    "thin-lib", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Create a thin static library (-lib), referencing the "
+                   "object files instead of containing copies of them "
+                   "(not supported for MSVC targets)"));
+
+namespace {
+// Object files generated in memory for -lib, see useInMemoryArchiveMembers().
+std::mutex inMemoryMembersMutex;
+StringMap<std::unique_ptr<MemoryBuffer>> inMemoryMembers;
+}
+
 /* Unlike the llvm-lib driver, llvm-ar is not available as library; it's
  * unfortunately a separate tool.
  * The following is a stripped-down version of LLVM's
@@ -46,6 +74,9 @@ bool Symtab = true;
 bool Deterministic = true;
 bool Thin = false;
 
+BumpPtrAllocator Alloc;
+StringSaver Saver(Alloc);
+
 void fail(Twine Error) { errs() << "llvm-ar: " << Error << ".\n"; }
 
 void fail(std::error_code EC, StringRef Context = {}) {
@@ -64,15 +95,44 @@ void fail(Error E, StringRef Context = {}) {
     return 1; \
   }
 
+Expected<NewArchiveMember> getNewMember(StringRef FileName) {
+#if LDC_LLVM_VER >= 500
+  {
+    std::lock_guard<std::mutex> lock(inMemoryMembersMutex);
+    auto it = inMemoryMembers.find(FileName);
+    if (it != inMemoryMembers.end())
+      return NewArchiveMember(it->second->getMemBufferRef());
+  }
+#endif
+  return NewArchiveMember::getFile(FileName, Deterministic);
+}
+
+// Thin archives refer to their members by path relative to the archive (or
+// absolute path if the member isn't located below the archive's directory).
+StringRef getThinMemberName(StringRef FileName) {
+  SmallString<128> Member(FileName);
+  SmallString<128> ArchiveDir(sys::path::parent_path(ArchiveName));
+  sys::fs::make_absolute(Member);
+  sys::fs::make_absolute(ArchiveDir);
+  sys::path::remove_dots(Member, /*remove_dot_dot=*/true);
+  sys::path::remove_dots(ArchiveDir, /*remove_dot_dot=*/true);
+
+  StringRef Name = Member;
+  if (Name.size() > ArchiveDir.size() && Name.startswith(ArchiveDir) &&
+      sys::path::is_separator(Name[ArchiveDir.size()]))
+    Name = Name.drop_front(ArchiveDir.size() + 1);
+  return Saver.save(Name);
+}
+
 int addMember(std::vector<NewArchiveMember> &Members, StringRef FileName,
               int Pos = -1) {
-  Expected<NewArchiveMember> NMOrErr =
-      NewArchiveMember::getFile(FileName, Deterministic);
+  Expected<NewArchiveMember> NMOrErr = getNewMember(FileName);
   failIfError(NMOrErr.takeError(), FileName);
 
 #if LDC_LLVM_VER >= 500
   // Use the basename of the object path for the member name.
-  NMOrErr->MemberName = sys::path::filename(NMOrErr->MemberName);
+  NMOrErr->MemberName = Thin ? getThinMemberName(FileName)
+                             : sys::path::filename(NMOrErr->MemberName);
 #endif
 
   if (Pos == -1)
@@ -173,6 +233,214 @@ object::Archive::Kind getKindFromMember(const NewArchiveMember &Member) {
   return getDefaultForHost();
 }
 
+#if LDC_LLVM_VER >= 500
+/* Unlike LLVM's writeArchive(), the GNU archive writer below collects the
+ * members' symbols in parallel, which matters for libraries with many members
+ * (especially bitcode members with -flto). Archives requiring a 64-bit symbol
+ * table are left to LLVM.
+ */
+
+bool isArchiveSymbol(const object::BasicSymbolRef &S) {
+  const uint32_t Flags = S.getFlags();
+  return !(Flags & object::SymbolRef::SF_FormatSpecific) &&
+         (Flags & object::SymbolRef::SF_Global) &&
+         !(Flags & object::SymbolRef::SF_Undefined);
+}
+
+// Sets Names to the null-terminated names of the member's global symbols.
+int computeMemberSymbols(const NewArchiveMember &Member, std::string &Names) {
+  LLVMContext Context;
+  Expected<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
+      object::SymbolicFile::createSymbolicFile(Member.Buf->getMemBufferRef(),
+                                               file_magic::unknown, &Context);
+  if (!ObjOrErr) {
+    // Members which aren't object files don't have any symbols.
+    consumeError(ObjOrErr.takeError());
+    return 0;
+  }
+
+  raw_string_ostream OS(Names);
+  for (const object::BasicSymbolRef &S : (*ObjOrErr)->symbols()) {
+    if (!isArchiveSymbol(S))
+      continue;
+    if (std::error_code EC = S.printName(OS)) {
+      fail(EC, Member.MemberName);
+      return 1;
+    }
+    OS << '\0';
+  }
+  OS.flush();
+  return 0;
+}
+
+int computeSymbols(ArrayRef<NewArchiveMember> Members,
+                   std::vector<std::string> &MemberSymbols) {
+  MemberSymbols.resize(Members.size());
+  std::vector<int> Status(Members.size());
+
+  std::atomic<size_t> NextMember(0);
+  auto Worker = [&] {
+    for (size_t I; (I = NextMember++) < Members.size();)
+      Status[I] = computeMemberSymbols(Members[I], MemberSymbols[I]);
+  };
+
+  const size_t NumThreads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), Members.size());
+  std::vector<std::thread> Threads;
+  for (size_t I = 1; I < NumThreads; ++I)
+    Threads.emplace_back(Worker);
+  Worker();
+  for (auto &Thread : Threads)
+    Thread.join();
+
+  for (int S : Status) {
+    if (S)
+      return S;
+  }
+  return 0;
+}
+
+template <typename T>
+void printWithSpacePadding(raw_fd_ostream &OS, T Data, unsigned Size) {
+  const uint64_t OldPos = OS.tell();
+  OS << Data;
+  const unsigned SizeSoFar = OS.tell() - OldPos;
+  OS.indent(Size - SizeSoFar);
+}
+
+void printMemberHeader(raw_fd_ostream &Out, StringRef Name, long long ModTime,
+                       unsigned UID, unsigned GID, unsigned Perms,
+                       uint64_t Size) {
+  printWithSpacePadding(Out, Name, 16);
+  printWithSpacePadding(Out, ModTime, 12);
+  printWithSpacePadding(Out, UID, 6);
+  printWithSpacePadding(Out, GID, 6);
+  printWithSpacePadding(Out, format("%o", Perms), 8);
+  printWithSpacePadding(Out, Size, 10);
+  Out << "`\n";
+}
+
+void printBE32(raw_ostream &Out, uint32_t Value) {
+  const char Bytes[4] = {char(Value >> 24), char(Value >> 16),
+                         char(Value >> 8), char(Value)};
+  Out.write(Bytes, 4);
+}
+
+bool fitsGNUArchive(ArrayRef<NewArchiveMember> Members) {
+  uint64_t Size = 0;
+  for (const auto &M : Members)
+    Size += 60 + M.Buf->getBufferSize();
+  return Size < (1ULL << 31);
+}
+
+int writeGNUArchive(ArrayRef<NewArchiveMember> Members) {
+  std::vector<std::string> MemberSymbols;
+  if (int Status = computeSymbols(Members, MemberSymbols))
+    return Status;
+
+  uint32_t NumSymbols = 0;
+  uint64_t SymtabSize = 4;
+  for (const auto &Names : MemberSymbols) {
+    const uint32_t N = std::count(Names.begin(), Names.end(), '\0');
+    NumSymbols += N;
+    SymtabSize += 4 * N + Names.size();
+  }
+
+  // Names which don't fit into the member header are stored in the string
+  // table and referenced as "/<offset>"; thin archives store all names there.
+  std::string StringTable;
+  std::vector<std::string> HeaderNames;
+  for (const auto &M : Members) {
+    const StringRef Name = M.MemberName;
+    if (!Thin && Name.size() < 16 && Name.find('/') == StringRef::npos) {
+      HeaderNames.push_back((Name + "/").str());
+    } else {
+      HeaderNames.push_back("/" + std::to_string(StringTable.size()));
+      StringTable += Name;
+      StringTable += "/\n";
+    }
+  }
+  if (StringTable.size() % 2)
+    StringTable += '\n';
+
+  uint64_t Offset = 8;
+  if (NumSymbols)
+    Offset += 60 + alignTo(SymtabSize, 2);
+  if (!StringTable.empty())
+    Offset += 60 + StringTable.size();
+  std::vector<uint32_t> MemberOffsets;
+  for (const auto &M : Members) {
+    MemberOffsets.push_back(Offset);
+    Offset += 60;
+    if (!Thin)
+      Offset += alignTo(M.Buf->getBufferSize(), 2);
+  }
+
+  // Write to a temporary file first, so that the archive is replaced
+  // atomically.
+  int FD;
+  SmallString<128> TmpArchive;
+  if (std::error_code EC = sys::fs::createUniqueFile(
+          ArchiveName + ".temp-archive-%%%%%%%.a", FD, TmpArchive)) {
+    fail(EC, ("error creating '" + ArchiveName + "'").str());
+    return 1;
+  }
+
+  {
+    raw_fd_ostream Out(FD, /*shouldClose=*/true);
+    Out << (Thin ? "!<thin>\n" : "!<arch>\n");
+
+    if (NumSymbols) {
+      printMemberHeader(Out, "/", 0, 0, 0, 0, alignTo(SymtabSize, 2));
+      printBE32(Out, NumSymbols);
+      for (size_t I = 0; I < Members.size(); ++I) {
+        const auto &Names = MemberSymbols[I];
+        for (size_t N = std::count(Names.begin(), Names.end(), '\0'); N; --N)
+          printBE32(Out, MemberOffsets[I]);
+      }
+      for (const auto &Names : MemberSymbols)
+        Out << Names;
+      if (SymtabSize % 2)
+        Out << '\0';
+    }
+
+    if (!StringTable.empty()) {
+      printWithSpacePadding(Out, "//", 48);
+      printWithSpacePadding(Out, StringTable.size(), 10);
+      Out << "`\n" << StringTable;
+    }
+
+    for (size_t I = 0; I < Members.size(); ++I) {
+      const auto &M = Members[I];
+      const StringRef Data = M.Buf->getBuffer();
+      printMemberHeader(Out, HeaderNames[I], sys::toTimeT(M.ModTime), M.UID,
+                        M.GID, M.Perms, Data.size());
+      if (!Thin) {
+        Out << Data;
+        if (Data.size() % 2)
+          Out << '\n';
+      }
+    }
+
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      sys::fs::remove(TmpArchive);
+      fail("error writing '" + ArchiveName + "'");
+      return 1;
+    }
+  }
+
+  if (std::error_code EC = sys::fs::rename(TmpArchive, ArchiveName)) {
+    sys::fs::remove(TmpArchive);
+    fail(EC, ("error writing '" + ArchiveName + "'").str());
+    return 1;
+  }
+
+  return 0;
+}
+#endif // LDC_LLVM_VER >= 500
+
 int performWriteOperation(object::Archive *OldArchive,
                           std::unique_ptr<MemoryBuffer> OldArchiveBuf) {
   std::vector<NewArchiveMember> NewMembers;
@@ -187,6 +455,11 @@ int performWriteOperation(object::Archive *OldArchive,
   else
     Kind = getKindFromMember(NewMembers.front());
 
+#if LDC_LLVM_VER >= 500
+  if (Kind == object::Archive::K_GNU && Symtab && fitsGNUArchive(NewMembers))
+    return writeGNUArchive(NewMembers);
+#endif
+
   auto Result =
       writeArchive(ArchiveName, NewMembers, Symtab, Kind, Deterministic, Thin,
                    std::move(OldArchiveBuf));
@@ -225,13 +498,14 @@ namespace {
 
 int internalAr(ArrayRef<const char *> args) {
   if (args.size() < 4 || strcmp(args[0], "llvm-ar") != 0 ||
-      strcmp(args[1], "rcs") != 0) {
+      (strcmp(args[1], "rcs") != 0 && strcmp(args[1], "rcsT") != 0)) {
     llvm_unreachable(
-        "Expected archiver command line: llvm-ar rcs <archive file> "
+        "Expected archiver command line: llvm-ar rcs[T] <archive file> "
         "<object file> ...");
     return -1;
   }
 
+  llvm_ar::Thin = strcmp(args[1], "rcsT") == 0;
   llvm_ar::ArchiveName = args[2];
 
   auto membersSlice = args.slice(3);
@@ -255,8 +529,21 @@ int internalLib(ArrayRef<const char *> args) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static llvm::cl::opt<std::string> ar("ar", llvm::cl::desc("Archiver"),
-                                     llvm::cl::Hidden, llvm::cl::ZeroOrMore);
+bool useInMemoryArchiveMembers() {
+#if LDC_LLVM_VER >= 500
+  // Only if the object files are removed after archiving anyway.
+  return global.params.lib && global.params.cleanupObjectFiles && ar.empty() &&
+         !thinLib && !global.params.targetTriple->isWindowsMSVCEnvironment();
+#else
+  return false;
+#endif
+}
+
+void addInMemoryArchiveMember(llvm::StringRef objectFile,
+                              std::unique_ptr<llvm::MemoryBuffer> buffer) {
+  std::lock_guard<std::mutex> lock(inMemoryMembersMutex);
+  inMemoryMembers[objectFile] = std::move(buffer);
+}
 
 int createStaticLibrary() {
   Logger::println("*** Creating static library ***");
@@ -282,9 +569,16 @@ int createStaticLibrary() {
   // build arguments
   std::vector<std::string> args;
 
-  // ask ar to create a new library
+  // ask ar to create a new (thin) library
   if (!isTargetMSVC) {
-    args.push_back("rcs");
+    args.push_back(thinLib ? "rcsT" : "rcs");
+  } else if (thinLib) {
+    warning(Loc(), "Ignoring -thin-lib for MSVC targets");
+  }
+
+  // The thin library refers to the object files, so they must be kept.
+  if (thinLib && !isTargetMSVC) {
+    global.params.cleanupObjectFiles = false;
   }
 
   // ask lib.exe to be quiet
@@ -343,6 +637,7 @@ int createStaticLibrary() {
 
     const int exitCode =
         isTargetMSVC ? internalLib(fullArgs) : internalAr(fullArgs);
+    inMemoryMembers.clear();
     if (exitCode)
       error(Loc(), "%s failed with status: %d", tool.c_str(), exitCode);
 
@@ -9,6 +9,26 @@
 
 #pragma once
 
+#include <memory>
+
+namespace llvm {
+class MemoryBuffer;
+class StringRef;
+}
+
+/**
+ * Indicates whether the object files for -lib are generated in memory and
+ * archived from there instead of being written to disk, as they are removed
+ * after archiving anyway.
+ */
+bool useInMemoryArchiveMembers();
+
+/**
+ * Registers the in-memory object file to be archived in place of objectFile.
+ */
+void addInMemoryArchiveMember(llvm::StringRef objectFile,
+                              std::unique_ptr<llvm::MemoryBuffer> buffer);
+
 /**
  * Create a static library from object files.
  * @return 0 on success.
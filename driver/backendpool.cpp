@@ -0,0 +1,235 @@
+//===-- backendpool.cpp ---------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/backendpool.h"
+
+#include "dmd/errors.h"
+#include "dmd/globals.h"
+#include "driver/cl_options.h"
+#include "driver/targetmachine.h"
+#include "driver/toobj.h"
+#include "gen/logger.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+
+extern thread_local llvm::TargetMachine *gTargetMachine;
+
+namespace {
+
+llvm::cl::opt<bool> codegenPipeline(
+    "codegen-pipeline", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Optimize and write the modules on a separate backend "
+                   "thread, overlapping with IR generation (implied by -j=N "
+                   "with N > 1)"));
+
+llvm::cl::opt<unsigned> codegenQueueDepth(
+    "codegen-queue-depth", llvm::cl::ZeroOrMore, llvm::cl::value_desc("N"),
+    llvm::cl::init(0),
+    llvm::cl::desc("Maximum number of generated modules waiting for the "
+                   "backend threads, limiting peak memory (default: 0 = "
+                   "unlimited)"));
+
+} // anonymous namespace
+
+namespace ldc {
+
+BackendPool::BackendPool(unsigned numThreads)
+    : mainTargetMachine_(*gTargetMachine), shutdown_(false),
+      finishedWorkers_(0), workerFailed_(false) {
+  workers_.reserve(numThreads);
+  for (unsigned i = 0; i < numThreads; ++i)
+    workers_.emplace_back(&BackendPool::workerMain, this);
+}
+
+BackendPool::~BackendPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  jobAvailable_.notify_all();
+
+  bool failed;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    workerDone_.wait(lock, [this] {
+      return workerFailed_ || finishedWorkers_ == workers_.size();
+    });
+    failed = workerFailed_;
+  }
+  // A failed worker never finishes; exit with the others still running.
+  if (failed)
+    reportDiagnostics();
+
+  for (auto &worker : workers_)
+    worker.join();
+  reportDiagnostics();
+}
+
+void BackendPool::reportDiagnostics() {
+  std::vector<CollectedDiagnostics> diagnostics;
+  bool failed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    diagnostics.swap(diagnostics_);
+    failed = workerFailed_;
+  }
+  for (auto &d : diagnostics)
+    reportCollectedDiagnostics(d);
+  if (failed)
+    fatal();
+}
+
+void BackendPool::onWorkerFatal(CollectedDiagnostics *diagnostics) {
+  auto pool = static_cast<BackendPool *>(diagnostics->context);
+  std::unique_lock<std::mutex> lock(pool->mutex_);
+  pool->diagnostics_.push_back(*diagnostics);
+  pool->workerFailed_ = true;
+  pool->queueNotFull_.notify_all();
+  pool->workerDone_.notify_all();
+  // The main thread reports the diagnostics and exits.
+  while (true)
+    pool->workerDone_.wait(lock);
+}
+
+unsigned BackendPool::getNumThreads(bool singleObj) {
+  unsigned numThreads = opts::codegenThreads;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+
+  if (numThreads == 0 || (numThreads == 1 && !codegenPipeline))
+    return 0;
+
+  // -singleobj only ever produces a single module, the logger isn't
+  // thread-safe, and optimization remarks are only collected for the main
+  // thread's context.
+  if (singleObj || Logger::enabled())
+    return 0;
+#if LDC_LLVM_VER >= 400
+  if (opts::saveOptimizationRecord.getNumOccurrences() > 0)
+    return 0;
+#endif
+
+  return numThreads;
+}
+
+void BackendPool::serializeModule(llvm::Module &m,
+                                  llvm::SmallVectorImpl<char> &bitcode) {
+  // Preserve the use-list order, as it may affect the optimizations and thus
+  // the emitted code.
+  llvm::raw_svector_ostream os(bitcode);
+#if LDC_LLVM_VER >= 700
+  llvm::WriteBitcodeToFile(m, os, /*ShouldPreserveUseListOrder=*/true);
+#else
+  llvm::WriteBitcodeToFile(&m, os, /*ShouldPreserveUseListOrder=*/true);
+#endif
+}
+
+std::unique_ptr<llvm::Module>
+BackendPool::materializeModule(llvm::StringRef bitcode,
+                               llvm::StringRef moduleId,
+                               llvm::LLVMContext &context) {
+  llvm::MemoryBufferRef buffer(bitcode, moduleId);
+  auto moduleOrErr = llvm::parseBitcodeFile(buffer, context);
+  if (!moduleOrErr) {
+#if LDC_LLVM_VER >= 400
+    const std::string msg = llvm::toString(moduleOrErr.takeError());
+#else
+    const std::string msg = moduleOrErr.getError().message();
+#endif
+    error(Loc(), "failed to hand over module %s to backend thread: %s",
+          moduleId.str().c_str(), msg.c_str());
+    fatal();
+  }
+  return std::move(moduleOrErr.get());
+}
+
+void BackendPool::submit(llvm::Module &m, const char *filename) {
+  bool failed;
+  Job job;
+  job.moduleId = m.getModuleIdentifier();
+  job.filename = filename;
+  serializeModule(m, job.bitcode);
+
+  {
+    // Block IR generation while the queue is full.
+    std::unique_lock<std::mutex> lock(mutex_);
+    queueNotFull_.wait(lock, [this] {
+      return workerFailed_ || codegenQueueDepth == 0 ||
+             jobs_.size() < codegenQueueDepth;
+    });
+    failed = workerFailed_;
+    if (!failed)
+      jobs_.push_back(std::move(job));
+  }
+  if (failed)
+    reportDiagnostics();
+  jobAvailable_.notify_one();
+}
+
+void BackendPool::workerMain() {
+  std::unique_ptr<llvm::TargetMachine> targetMachine(
+      cloneTargetMachine(mainTargetMachine_));
+  gTargetMachine = targetMachine.get();
+
+  CollectedDiagnostics diagnostics = {};
+  diagnostics.onFatal = &BackendPool::onWorkerFatal;
+  diagnostics.context = this;
+  collectDiagnostics(&diagnostics);
+
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      jobAvailable_.wait(lock, [this] { return shutdown_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        break;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    queueNotFull_.notify_one();
+
+    llvm::LLVMContext context;
+    if (!global.params.output_ll)
+      context.setDiscardValueNames(true);
+
+    std::unique_ptr<llvm::Module> m = materializeModule(
+        llvm::StringRef(job.bitcode.data(), job.bitcode.size()), job.moduleId,
+        context);
+    writeModule(m.get(), job.filename.c_str());
+
+    if (diagnostics.length || diagnostics.errors || diagnostics.warnings) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      diagnostics_.push_back(diagnostics);
+      diagnostics.text = nullptr;
+      diagnostics.length = 0;
+      diagnostics.errors = 0;
+      diagnostics.warnings = 0;
+    }
+  }
+
+  collectDiagnostics(nullptr);
+  gTargetMachine = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++finishedWorkers_;
+  }
+  workerDone_.notify_all();
+}
+}
@@ -0,0 +1,97 @@
+//===-- driver/backendpool.h - Concurrent module optimization ---*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Contains ldc::BackendPool, a set of worker threads optimizing finished LLVM
+// modules and writing them to the requested output files (`writeModule()`),
+// while the main thread keeps on generating IR for the remaining modules.
+// The queue of pending modules may be bounded, in which case IR generation
+// waits for the backend to catch up.
+//
+// LLVM contexts and target machines must not be shared across threads, so
+// each module is handed over as in-memory bitcode and re-materialized in a
+// context owned by the worker.
+//
+// The frontend's diagnostics aren't thread-safe either: the workers collect
+// theirs (see collectDiagnostics()), and the main thread reports them after
+// joining the workers, or as soon as a worker runs into a fatal error.
+//
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "dmd/errors.h"
+#include "llvm/ADT/SmallVector.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+class StringRef;
+class TargetMachine;
+}
+
+namespace ldc {
+
+class BackendPool {
+public:
+  explicit BackendPool(unsigned numThreads);
+  /// Waits until all submitted modules have been written and reports the
+  /// workers' diagnostics.
+  ~BackendPool();
+
+  /// Serializes the module and schedules it for being written to `filename`.
+  /// The module can be freed by the caller afterwards. Blocks while the queue
+  /// of pending modules is full.
+  void submit(llvm::Module &m, const char *filename);
+
+  /// Returns the number of worker threads to use, or 0 if the modules are to
+  /// be written serially by the IR-generating thread.
+  static unsigned getNumThreads(bool singleObj);
+
+  /// Serializes the module for handing it over to another thread.
+  static void serializeModule(llvm::Module &m,
+                              llvm::SmallVectorImpl<char> &bitcode);
+  /// Re-materializes a serialized module in the given context.
+  static std::unique_ptr<llvm::Module>
+  materializeModule(llvm::StringRef bitcode, llvm::StringRef moduleId,
+                    llvm::LLVMContext &context);
+
+private:
+  struct Job {
+    std::string moduleId;
+    llvm::SmallVector<char, 0> bitcode;
+    std::string filename;
+  };
+
+  void workerMain();
+  static void onWorkerFatal(CollectedDiagnostics *diagnostics);
+  /// Reports the diagnostics collected so far, exiting if a worker ran into
+  /// a fatal error. Main thread only.
+  void reportDiagnostics();
+
+  const llvm::TargetMachine &mainTargetMachine_;
+  std::mutex mutex_;
+  std::condition_variable jobAvailable_;
+  std::condition_variable queueNotFull_;
+  std::condition_variable workerDone_;
+  std::deque<Job> jobs_;
+  bool shutdown_;
+  std::vector<std::thread> workers_;
+  unsigned finishedWorkers_;
+  std::vector<CollectedDiagnostics> diagnostics_;
+  bool workerFailed_; // a worker called fatal()
+};
+}
@@ -18,45 +18,74 @@
 // changes that trigger recompilation of many files but with little effective
 // changes (in the extreme case, adding a comment in a "globals.d").
 //
-// The current limitation is that hashing and cache look-up are done with
-// whole-module granularity. Future work could attempt to do this for module
-// "fragments".
+// Hashing and look-up are done with whole-module granularity. Additionally,
+// with -cache-fragments=N, a module missing in the cache is split into N
+// fragments after optimization (see driver/toobj.cpp). Each fragment is looked
+// up and cached separately, so that after a small change only the affected
+// fragments go through machine codegen.
 //
 // The hash depends on the IR code (obviously), but also on the compiler+LLVM
 // versions and several compile flags (e.g. -O*, -mcpu, and -mattr).
+// With -cache-server=<socket>, the objects are looked up in and stored to a
+// running ldc-cache-server instead of a cache directory (see
+// driver/cache_client.cpp).
+//
+// With -cache-compress, objects are stored zlib-compressed and decompressed
+// into the output file on cache hits, trading CPU time for cache size.
+// Entries of either format are found regardless of the option.
+//
+// With -cache-stats=<file>, a JSON report about the hits and misses and the
+// time spent is written. To estimate the time saved by a hit, the time spent
+// on optimization and machine codegen is stored with each cache entry
+// (`<cache file>.time`, or by the cache server).
+//
+// By default, the IR is hashed by streaming its structure directly into
+// xxHash (see driver/cache_irhash.cpp); -cache-hash=bitcode selects the
+// original, slower MD5 hash of the serialized bitcode instead. The hidden
+// -cache-hash-benchmark option prints the hashes and hashing times of both
+// modes for each module, for comparing them. With LLVM 3.9, which lacks
+// xxHash, the IR structure is hashed with MD5.
 //
 //===----------------------------------------------------------------------===//
 
 #include "driver/cache.h"
 
 #include "dmd/errors.h"
+#include "driver/cache_client.h"
+#include "driver/cache_irhash.h"
 #include "driver/cache_pruning.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_sanitizers.h"
+#include "driver/json.h"
 #include "driver/ldc-version.h"
+#include "driver/timetrace.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 
 #if LDC_LLVM_VER >= 400
 #include "llvm/Bitcode/BitcodeWriter.h"
-#include "llvm/Support/Chrono.h"
 #else
 #include "llvm/Bitcode/ReaderWriter.h"
-#include "llvm/Support/TimeValue.h"
 #endif
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
-
-// Include close() declaration.
-#if !defined(_MSC_VER) && !defined(__MINGW32__)
-#include <unistd.h>
-#else
-#include <io.h>
+#if LDC_LLVM_VER >= 400
+#include "llvm/Support/xxhash.h"
 #endif
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
 
 #if LDC_POSIX
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
 // Returns true upon error.
 static bool createHardLink(const char *to, const char *from) {
@@ -155,6 +184,34 @@ llvm::cl::opt<RetrievalMode> cacheRecoveryMode(
         clEnumValN(RetrievalMode::SymLink, "symlink",
                    "Create a symbolic link to the cache file")));
 
+llvm::cl::opt<bool> cacheCompression(
+    "cache-compress", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Store zlib-compressed object files in the cache; they are "
+                   "always copied on retrieval"));
+
+llvm::cl::opt<std::string> cacheStatsFile(
+    "cache-stats", llvm::cl::ZeroOrMore, llvm::cl::value_desc("file"),
+    llvm::cl::desc("Write statistics about the IR-to-object cache hits and "
+                   "misses to <file> (JSON)"));
+
+enum class HashMode { IR, Bitcode };
+llvm::cl::opt<HashMode> cacheHashMode(
+    "cache-hash", llvm::cl::ZeroOrMore,
+    llvm::cl::desc(
+        "Set how the LLVM IR is hashed for the cache (default: ir)."),
+    llvm::cl::init(HashMode::IR),
+    clEnumValues(
+        clEnumValN(HashMode::IR, "ir",
+                   "Stream the IR structure into a fast non-cryptographic "
+                   "hash"),
+        clEnumValN(HashMode::Bitcode, "bitcode",
+                   "MD5 hash of the serialized bitcode (slower)")));
+
+llvm::cl::opt<bool> cacheHashBenchmark(
+    "cache-hash-benchmark", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::desc("Hash each module with every -cache-hash mode and print "
+                   "the hashes and the time taken to stderr"));
+
 bool isPruningEnabled() {
   if (pruneEnabled)
     return true;
@@ -169,15 +226,129 @@ bool isPruningEnabled() {
   return false;
 }
 
-#if LDC_LLVM_VER >= 400
-llvm::sys::TimePoint<std::chrono::seconds> getTimeNow() {
-  using namespace std::chrono;
-  return time_point_cast<seconds>(system_clock::now());
-}
+/// The cache index is compacted once it has grown past this size and twice its
+/// size after the previous compaction, as it is only compacted by pruning
+/// otherwise.
+const uint64_t indexCompactionThreshold = 4 << 20;
+
+/// Holds a shared lock on the cache index's lock file while appending to the
+/// index. Pruning and compaction lock it exclusively while taking over the
+/// index (see driver/cache_pruning.d), so that no records are appended to the
+/// taken-over index after it has been read.
+/// Failures are ignored, appending without the lock.
+class CacheIndexLock {
+#if LDC_POSIX
+  int fd;
+
+public:
+  explicit CacheIndexLock(const char *lockFile) {
+    fd = open(lockFile, O_RDWR | O_CREAT, 0666);
+    if (fd == -1)
+      return;
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) == -1 && errno == EINTR) {
+    }
+  }
+  ~CacheIndexLock() {
+    if (fd != -1)
+      close(fd);
+  }
+#elif _WIN32
+  HANDLE handle;
+
+public:
+  explicit CacheIndexLock(const char *lockFile) {
+    handle = INVALID_HANDLE_VALUE;
+    llvm::SmallVector<wchar_t, 128> wideLockFile;
+    if (llvm::sys::path::widenPath(lockFile, wideLockFile))
+      return;
+    handle = CreateFileW(wideLockFile.begin(), GENERIC_READ | GENERIC_WRITE,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE |
+                             FILE_SHARE_DELETE,
+                         nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+      return;
+    OVERLAPPED overlapped = {};
+    LockFileEx(handle, 0, 0, MAXDWORD, MAXDWORD, &overlapped);
+  }
+  ~CacheIndexLock() {
+    if (handle != INVALID_HANDLE_VALUE)
+      CloseHandle(handle);
+  }
 #else
-llvm::sys::TimeValue getTimeNow() { return llvm::sys::TimeValue::now(); }
+public:
+  explicit CacheIndexLock(const char *) {}
 #endif
 
+  CacheIndexLock(const CacheIndexLock &) = delete;
+  CacheIndexLock &operator=(const CacheIndexLock &) = delete;
+};
+
+/// Returns whether the cache index has grown enough since its previous
+/// compaction, whose resulting size is stored in `ircache_index_compacted`.
+bool shouldCompactCacheIndex(llvm::StringRef indexFile) {
+  uint64_t size;
+  if (llvm::sys::fs::file_size(indexFile, size) ||
+      size <= indexCompactionThreshold)
+    return false;
+
+  llvm::SmallString<128> compactedSizeFile(indexFile);
+  compactedSizeFile += "_compacted";
+  uint64_t compactedSize = 0;
+  auto buffer = llvm::MemoryBuffer::getFile(compactedSizeFile);
+  if (buffer &&
+      (*buffer)->getBuffer().trim().getAsInteger(10, compactedSize))
+    compactedSize = 0;
+  return size > 2 * compactedSize;
+}
+
+/// Appends a record for a cache file to the cache index, a journal of
+/// insertions and hits used for pruning (see driver/cache_pruning.d).
+/// Each record is a single line `<kind> <unix time> <size> <file name>`, with
+/// kind 'A' for an added file and 'H' for a hit. Records are appended with a
+/// single write, so that concurrent compiler invocations don't interfere.
+/// Failures are ignored; files missing in the index are only found by a full
+/// rescan of the cache directory.
+/// Without -cache-prune (e.g., when pruning with ldc-prune-cache), nothing
+/// else keeps the index from growing, so it is compacted past a threshold.
+void appendToCacheIndex(char kind, llvm::StringRef cacheFile, uint64_t size) {
+  using namespace std::chrono;
+  const auto now =
+      duration_cast<seconds>(system_clock::now().time_since_epoch());
+
+  llvm::SmallString<128> record;
+  llvm::raw_svector_ostream(record)
+      << kind << ' ' << static_cast<uint64_t>(now.count()) << ' ' << size
+      << ' ' << llvm::sys::path::filename(cacheFile) << '\n';
+
+  llvm::SmallString<128> indexFile(opts::cacheDir);
+  llvm::sys::path::append(indexFile, "ircache_index");
+  {
+    llvm::SmallString<128> lockFile(indexFile);
+    lockFile += ".lock";
+    CacheIndexLock lock(lockFile.c_str());
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(indexFile, ec, llvm::sys::fs::F_Append);
+    if (ec) {
+      IF_LOG Logger::println("Failed to open cache index: %s",
+                             ec.message().c_str());
+      return;
+    }
+    // Unbuffered, to write the whole record at once.
+    os.SetUnbuffered();
+    os << record;
+  }
+
+  if (shouldCompactCacheIndex(indexFile)) {
+    IF_LOG Logger::println("Compact cache index: %s", indexFile.c_str());
+    ::compactCacheIndex(opts::cacheDir.data(), opts::cacheDir.size());
+  }
+}
+
 /// A raw_ostream that creates a hash of what is written to it.
 /// This class does not encounter output errors.
 /// There is no buffering and the hasher can be used at any time.
@@ -206,11 +377,211 @@ public:
   }
 };
 
+#if LDC_LLVM_VER >= 400
+/// A raw_ostream that creates a 128-bit xxHash of what is written to it.
+/// The data is hashed in fixed-size chunks by two lanes of 64-bit xxHash,
+/// each chunk being prefixed with the lane's hash of the previous chunk.
+/// This class does not encounter output errors.
+class raw_xxhash_ostream : public llvm::raw_ostream {
+  enum : size_t { chunkSize = 64 * 1024, prefixSize = sizeof(uint64_t) };
+
+  // The chunk being filled, preceded by room for the chaining prefix.
+  llvm::SmallVector<char, 0> chunk;
+  uint64_t lanes[2] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+
+  void hashChunk() {
+    for (uint64_t &lane : lanes) {
+      std::memcpy(chunk.data(), &lane, prefixSize);
+      lane = llvm::xxHash64(llvm::StringRef(chunk.data(), chunk.size()));
+    }
+    chunk.resize(prefixSize);
+  }
+
+  /// See raw_ostream::write_impl.
+  void write_impl(const char *ptr, size_t size) override {
+    while (size) {
+      const size_t n =
+          std::min<size_t>(size, prefixSize + chunkSize - chunk.size());
+      chunk.append(ptr, ptr + n);
+      ptr += n;
+      size -= n;
+      if (chunk.size() == prefixSize + chunkSize)
+        hashChunk();
+    }
+  }
+
+  uint64_t current_pos() const override { return 0; }
+
+public:
+  raw_xxhash_ostream() {
+    SetUnbuffered();
+    chunk.reserve(prefixSize + chunkSize);
+    chunk.resize(prefixSize);
+  }
+  ~raw_xxhash_ostream() override {}
+
+  void flush() = delete;
+
+  void resultAsString(llvm::SmallString<32> &str) {
+    hashChunk();
+    str.clear();
+    llvm::raw_svector_ostream os(str);
+    os << llvm::format_hex_no_prefix(lanes[0], 16)
+       << llvm::format_hex_no_prefix(lanes[1], 16);
+  }
+};
+#else
+// LLVM 3.9 lacks xxHash; the IR structure is hashed with MD5 instead, which
+// still avoids serializing the module.
+using raw_xxhash_ostream = raw_hash_ostream;
+#endif
+
 void storeCacheFileName(llvm::StringRef cacheObjectHash,
-                        llvm::SmallString<128> &filePath) {
+                        llvm::SmallString<128> &filePath,
+                        bool compressed = cacheCompression) {
   filePath = opts::cacheDir;
   llvm::sys::path::append(filePath, llvm::Twine("ircache_") + cacheObjectHash +
-                                        "." + global.obj_ext);
+                                        "." + global.obj_ext +
+                                        (compressed ? ".z" : ""));
+}
+
+/// Looks for a cache file of either format, preferring the one selected by
+/// -cache-compress. Returns false if there is none.
+bool findCacheFile(llvm::StringRef cacheObjectHash,
+                   llvm::SmallString<128> &filePath, bool &compressed) {
+  for (bool c : {cacheCompression.getValue(), !cacheCompression}) {
+    storeCacheFileName(cacheObjectHash, filePath, c);
+    if (llvm::sys::fs::exists(filePath.c_str())) {
+      compressed = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Compressed cache files consist of this magic, the little-endian 64-bit size
+// of the uncompressed object file, and the zlib-compressed object file.
+const char compressedMagic[4] = {'L', 'D', 'C', 'Z'};
+const size_t compressedHeaderSize = sizeof(compressedMagic) + sizeof(uint64_t);
+
+std::unique_ptr<llvm::MemoryBuffer> readFileOrFail(llvm::StringRef path) {
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(
+      path, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!bufferOrErr) {
+    error(Loc(), "Failed to read file: %s (%s)", path.str().c_str(),
+          bufferOrErr.getError().message().c_str());
+    fatal();
+  }
+  return std::move(bufferOrErr.get());
+}
+
+void writeFileOrFail(llvm::StringRef path,
+                     llvm::ArrayRef<llvm::StringRef> chunks) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::F_None);
+  if (!ec) {
+    for (auto chunk : chunks)
+      os << chunk;
+    os.close();
+    ec = os.error();
+    os.clear_error();
+  }
+  if (ec) {
+    error(Loc(), "Failed to write file: %s (%s)", path.str().c_str(),
+          ec.message().c_str());
+    fatal();
+  }
+}
+
+void checkZlibAvailable() {
+  if (!llvm::zlib::isAvailable()) {
+    error(Loc(), "Compressed cache files require LLVM to be built with zlib");
+    fatal();
+  }
+}
+
+void compressObjectFile(llvm::StringRef objectFile, llvm::StringRef destFile) {
+  checkZlibAvailable();
+  const auto start = std::chrono::steady_clock::now();
+
+  auto buffer = readFileOrFail(objectFile);
+  llvm::SmallVector<char, 0> compressed;
+#if LDC_LLVM_VER >= 500
+  if (llvm::Error e = llvm::zlib::compress(buffer->getBuffer(), compressed)) {
+    error(Loc(), "Failed to compress object file %s: %s",
+          objectFile.str().c_str(), llvm::toString(std::move(e)).c_str());
+    fatal();
+  }
+#else
+  if (llvm::zlib::compress(buffer->getBuffer(), compressed) !=
+      llvm::zlib::StatusOK) {
+    error(Loc(), "Failed to compress object file %s", objectFile.str().c_str());
+    fatal();
+  }
+#endif
+
+  char header[compressedHeaderSize];
+  memcpy(header, compressedMagic, sizeof(compressedMagic));
+  llvm::support::endian::write64le(header + sizeof(compressedMagic),
+                                   buffer->getBufferSize());
+  writeFileOrFail(destFile,
+                  {llvm::StringRef(header, compressedHeaderSize),
+                   llvm::StringRef(compressed.data(), compressed.size())});
+
+  IF_LOG {
+    const size_t originalSize = buffer->getBufferSize();
+    const size_t compressedSize = compressedHeaderSize + compressed.size();
+    Logger::println("Compressed object file: %llu -> %llu bytes (%.1f%%) in "
+                    "%.3f ms",
+                    static_cast<unsigned long long>(originalSize),
+                    static_cast<unsigned long long>(compressedSize),
+                    originalSize ? 100.0 * compressedSize / originalSize : 0.0,
+                    millisecondsSince(start));
+  }
+}
+
+void decompressObjectFile(llvm::StringRef cacheFile,
+                          llvm::StringRef objectFile) {
+  checkZlibAvailable();
+  const auto start = std::chrono::steady_clock::now();
+
+  auto buffer = readFileOrFail(cacheFile);
+  const llvm::StringRef contents = buffer->getBuffer();
+  if (contents.size() < compressedHeaderSize ||
+      !contents.startswith(
+          llvm::StringRef(compressedMagic, sizeof(compressedMagic)))) {
+    error(Loc(), "Corrupt compressed cache file: %s", cacheFile.str().c_str());
+    fatal();
+  }
+  const uint64_t originalSize = llvm::support::endian::read64le(
+      contents.data() + sizeof(compressedMagic));
+
+  llvm::SmallVector<char, 0> decompressed;
+#if LDC_LLVM_VER >= 500
+  if (llvm::Error e = llvm::zlib::uncompress(
+          contents.drop_front(compressedHeaderSize), decompressed,
+          originalSize)) {
+    error(Loc(), "Failed to decompress cached file %s: %s",
+          cacheFile.str().c_str(), llvm::toString(std::move(e)).c_str());
+    fatal();
+  }
+#else
+  if (llvm::zlib::uncompress(contents.drop_front(compressedHeaderSize),
+                             decompressed,
+                             originalSize) != llvm::zlib::StatusOK) {
+    error(Loc(), "Failed to decompress cached file %s",
+          cacheFile.str().c_str());
+    fatal();
+  }
+#endif
+
+  writeFileOrFail(objectFile,
+                  {llvm::StringRef(decompressed.data(), decompressed.size())});
+
+  IF_LOG Logger::println(
+      "Decompressed cached object file: %llu -> %llu bytes in %.3f ms",
+      static_cast<unsigned long long>(contents.size()),
+      static_cast<unsigned long long>(originalSize), millisecondsSince(start));
 }
 
 // Output to `hash_os` all commandline flags, and try to skip the ones that have
@@ -273,6 +644,18 @@ void outputIR2ObjRelevantCmdlineArgs(llvm::raw_ostream &hash_os) {
       // All  "-cache..." options can be ignored
       if (strncmp(arg + 1, "cache", 5) == 0)
         continue;
+      // The backend threading options don't influence the output. Their
+      // values may also be passed as separate arguments ("-j 4").
+      if (arg[1] == 'j' && (!arg[2] || arg[2] == '=')) {
+        if (!arg[2] && it + 1 != end_it)
+          ++it;
+        continue;
+      }
+      if (strncmp(arg + 1, "codegen-", 8) == 0) {
+        if (strcmp(arg + 1, "codegen-queue-depth") == 0 && it + 1 != end_it)
+          ++it;
+        continue;
+      }
       // Ignore "-lib"
       if (arg[1] == 'l' && arg[2] == 'i' && arg[3] == 'b' && !arg[4])
         continue;
@@ -316,6 +699,7 @@ void outputIR2ObjRelevantCmdlineArgs(llvm::raw_ostream &hash_os) {
   hash_os << opts::getCodeModel();
 #endif
   hash_os << opts::disableFPElim();
+  hash_os << static_cast<int>(opts::ltoMode);
 }
 
 // Output to `hash_os` all environment flags that influence object code output
@@ -324,12 +708,15 @@ void outputIR2ObjRelevantEnvironmentOpts(llvm::raw_ostream &hash_os) {
   // There are no relevant environment options at the moment.
 }
 
-} // anonymous namespace
-
-namespace cache {
+template <typename HashOStream>
+void hashModule(llvm::Module *m, llvm::SmallString<32> &str, bool isFragment,
+                HashMode mode) {
+  HashOStream hash_os;
 
-void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str) {
-  raw_hash_ostream hash_os;
+  // Fragments are optimized IR, which must not be confused with a module's
+  // unoptimized IR.
+  if (isFragment)
+    hash_os << "fragment";
 
   // Let hash depend on the compiler version:
   hash_os << global.ldc_version << global.version << global.llvm_version
@@ -340,17 +727,143 @@ void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str) {
   // for hashing:
   outputIR2ObjRelevantCmdlineArgs(hash_os);
   outputIR2ObjRelevantEnvironmentOpts(hash_os);
+  hash_os << static_cast<int>(mode);
 
+  if (mode == HashMode::IR) {
+    cache::streamModuleStructure(*m, hash_os);
+  } else {
 #if LDC_LLVM_VER >= 700
-  llvm::WriteBitcodeToFile(*m, hash_os);
+    llvm::WriteBitcodeToFile(*m, hash_os);
 #else
-  llvm::WriteBitcodeToFile(m, hash_os);
+    llvm::WriteBitcodeToFile(m, hash_os);
 #endif
+  }
   hash_os.resultAsString(str);
-  IF_LOG Logger::println("Module's LLVM bitcode hash is: %s", str.c_str());
 }
 
-std::string cacheLookup(llvm::StringRef cacheObjectHash) {
+void computeModuleHash(llvm::Module *m, llvm::SmallString<32> &str,
+                       bool isFragment, HashMode mode) {
+  if (mode == HashMode::IR) {
+    hashModule<raw_xxhash_ostream>(m, str, isFragment, mode);
+  } else {
+    hashModule<raw_hash_ostream>(m, str, isFragment, mode);
+  }
+}
+
+/// Hashes the module with each -cache-hash mode and prints the hashes and the
+/// best of several timings to stderr, see -cache-hash-benchmark.
+void benchmarkHashModes(llvm::Module *m, bool isFragment) {
+  const int repetitions = 5;
+  for (HashMode mode : {HashMode::IR, HashMode::Bitcode}) {
+    llvm::SmallString<32> str;
+    double best = 0;
+    for (int i = 0; i < repetitions; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      computeModuleHash(m, str, isFragment, mode);
+      const double time = millisecondsSince(start);
+      if (i == 0 || time < best)
+        best = time;
+    }
+    llvm::errs() << "cache hash benchmark: " << m->getModuleIdentifier()
+                 << (mode == HashMode::IR ? " ir " : " bitcode ") << str
+                 << ' ' << llvm::format("%.3f", best) << " ms\n";
+  }
+}
+
+/// Cache statistics of a module or fragment, see -cache-stats.
+struct CacheStats {
+  std::string hash;
+  std::string objectFile;
+  bool isFragment = false;
+  bool hit = false;
+  double hashTime = 0;     // ms
+  double lookupTime = 0;   // ms
+  double recoveryTime = 0; // ms
+  uint64_t bytesRestored = 0;
+  // Time spent on optimization and machine codegen for a miss, or the time
+  // stored with the cache entry for a hit (negative if unknown).
+  double codegenTime = -1; // ms
+};
+
+std::mutex statsMutex;
+std::vector<CacheStats> stats;
+
+/// Updates the statistics for the cache entry, if enabled. May be called from
+/// multiple backend threads.
+template <typename F> void updateStats(llvm::StringRef hash, F update) {
+  if (cacheStatsFile.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(statsMutex);
+  // The entries of a module are updated one after another, so the most recent
+  // entries are checked first.
+  for (auto it = stats.rbegin(), end = stats.rend(); it != end; ++it) {
+    if (it->hash == hash) {
+      update(*it);
+      return;
+    }
+  }
+  stats.emplace_back();
+  stats.back().hash = hash.str();
+  update(stats.back());
+}
+
+void storeTimingFileName(llvm::StringRef cacheFile,
+                         llvm::SmallString<128> &timingFile) {
+  timingFile = cacheFile;
+  timingFile += ".time";
+}
+
+/// Stores the time spent generating the object in the cache, which is the
+/// estimate of the time saved by each later hit.
+void writeCodegenTime(llvm::StringRef cacheFile, double codegenTime) {
+  llvm::SmallString<128> timingFile;
+  storeTimingFileName(cacheFile, timingFile);
+  std::error_code ec;
+  llvm::raw_fd_ostream os(timingFile, ec, llvm::sys::fs::F_None);
+  if (!ec)
+    os << llvm::format("%.3f", codegenTime);
+}
+
+double readCodegenTime(llvm::StringRef cacheFile) {
+  llvm::SmallString<128> timingFile;
+  storeTimingFileName(cacheFile, timingFile);
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(timingFile);
+  double codegenTime;
+  if (!bufferOrErr ||
+      sscanf(bufferOrErr.get()->getBufferStart(), "%lf", &codegenTime) != 1)
+    return -1;
+  return codegenTime;
+}
+
+} // anonymous namespace
+
+namespace cache {
+
+void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str,
+                         bool isFragment) {
+  if (cacheHashBenchmark)
+    benchmarkHashModes(m, isFragment);
+
+  const auto start = std::chrono::steady_clock::now();
+  computeModuleHash(m, str, isFragment, cacheHashMode);
+  const double hashTime = millisecondsSince(start);
+  IF_LOG Logger::println("Module's LLVM %s hash is: %s (%.3f ms)",
+                         cacheHashMode == HashMode::IR ? "IR" : "bitcode",
+                         str.c_str(), hashTime);
+  updateStats(str, [&](CacheStats &s) {
+    s.isFragment = isFragment;
+    s.hashTime = hashTime;
+  });
+}
+
+llvm::StringRef cacheLocation() {
+  if (!opts::cacheServer.empty())
+    return opts::cacheServer;
+  return opts::cacheDir;
+}
+
+static std::string lookupInCacheDirectory(llvm::StringRef cacheObjectHash) {
   if (opts::cacheDir.empty())
     return "";
 
@@ -360,8 +873,8 @@ std::string cacheLookup(llvm::StringRef cacheObjectHash) {
   }
 
   llvm::SmallString<128> filePath;
-  storeCacheFileName(cacheObjectHash, filePath);
-  if (llvm::sys::fs::exists(filePath.c_str())) {
+  bool compressed;
+  if (findCacheFile(cacheObjectHash, filePath, compressed)) {
     IF_LOG Logger::println("Cache object found! %s", filePath.c_str());
     return filePath.str().str();
   }
@@ -370,8 +883,37 @@ std::string cacheLookup(llvm::StringRef cacheObjectHash) {
   return "";
 }
 
+std::string cacheLookup(llvm::StringRef cacheObjectHash) {
+  const auto start = std::chrono::steady_clock::now();
+
+  std::string result;
+  if (!opts::cacheServer.empty()) {
+    if (client::lookup(cacheObjectHash))
+      result = (llvm::Twine(opts::cacheServer) + ":" + cacheObjectHash).str();
+  } else {
+    result = lookupInCacheDirectory(cacheObjectHash);
+  }
+
+  const double lookupTime = millisecondsSince(start);
+  updateStats(cacheObjectHash, [&](CacheStats &s) {
+    s.hit = !result.empty();
+    s.lookupTime = lookupTime;
+  });
+  return result;
+}
+
 void cacheObjectFile(llvm::StringRef objectFile,
-                     llvm::StringRef cacheObjectHash) {
+                     llvm::StringRef cacheObjectHash, double codegenTime) {
+  updateStats(cacheObjectHash, [&](CacheStats &s) {
+    s.objectFile = objectFile.str();
+    s.codegenTime = codegenTime;
+  });
+
+  if (!opts::cacheServer.empty()) {
+    client::cacheObjectFile(objectFile, cacheObjectHash, codegenTime);
+    return;
+  }
+
   if (opts::cacheDir.empty())
     return;
 
@@ -396,12 +938,18 @@ void cacheObjectFile(llvm::StringRef objectFile,
     fatal();
   }
 
-  IF_LOG Logger::println("Copy object file to temp file: %s to %s",
-                         objectFile.str().c_str(), tempFile.c_str());
-  if (llvm::sys::fs::copy_file(objectFile, tempFile.c_str())) {
-    error(Loc(), "Failed to copy object file to cache: %s to %s",
-          objectFile.str().c_str(), tempFile.c_str());
-    fatal();
+  if (cacheCompression) {
+    IF_LOG Logger::println("Compress object file to temp file: %s to %s",
+                           objectFile.str().c_str(), tempFile.c_str());
+    compressObjectFile(objectFile, tempFile);
+  } else {
+    IF_LOG Logger::println("Copy object file to temp file: %s to %s",
+                           objectFile.str().c_str(), tempFile.c_str());
+    if (llvm::sys::fs::copy_file(objectFile, tempFile.c_str())) {
+      error(Loc(), "Failed to copy object file to cache: %s to %s",
+            objectFile.str().c_str(), tempFile.c_str());
+      fatal();
+    }
   }
   IF_LOG Logger::println("Rename temp file to cache file: %s to %s",
                          tempFile.c_str(), cacheFile.c_str());
@@ -410,16 +958,49 @@ void cacheObjectFile(llvm::StringRef objectFile,
           tempFile.c_str(), cacheFile.c_str());
     fatal();
   }
+
+  uint64_t size = 0;
+  llvm::sys::fs::file_size(cacheFile.c_str(), size);
+
+  // The size recorded in the index includes the timing file, which is pruned
+  // together with the object file.
+  if (codegenTime >= 0) {
+    writeCodegenTime(cacheFile, codegenTime);
+    llvm::SmallString<128> timingFile;
+    storeTimingFileName(cacheFile, timingFile);
+    uint64_t timingSize = 0;
+    if (!llvm::sys::fs::file_size(timingFile.c_str(), timingSize))
+      size += timingSize;
+  }
+
+  appendToCacheIndex('A', cacheFile, size);
 }
 
-void recoverObjectFile(llvm::StringRef cacheObjectHash,
-                       llvm::StringRef objectFile) {
+static void recoverFromCacheDirectory(llvm::StringRef cacheObjectHash,
+                                      llvm::StringRef objectFile,
+                                      double &codegenTime) {
   llvm::SmallString<128> cacheFile;
-  storeCacheFileName(cacheObjectHash, cacheFile);
+  bool compressed = false;
+  findCacheFile(cacheObjectHash, cacheFile, compressed);
+  if (!cacheStatsFile.empty())
+    codegenTime = readCodegenTime(cacheFile);
+
+  // Record the access in the cache index, so that the pruning algorithm sees
+  // that the file should be kept over older files. The file's last-accessed
+  // time isn't reliable for that, as not all systems update it, and reading it
+  // requires a stat of every cache file when pruning.
+  appendToCacheIndex('H', cacheFile, 0);
 
   // Remove the potentially pre-existing output file.
   llvm::sys::fs::remove(objectFile);
 
+  if (compressed) {
+    IF_LOG Logger::println("Decompress cached object file: %s -> %s",
+                           cacheFile.c_str(), objectFile.str().c_str());
+    decompressObjectFile(cacheFile, objectFile);
+    return;
+  }
+
   switch (cacheRecoveryMode) {
   case RetrievalMode::Copy: {
     IF_LOG Logger::println("Copy cached object file: %s -> %s",
@@ -459,32 +1040,89 @@ void recoverObjectFile(llvm::StringRef cacheObjectHash,
     }
   } break;
   }
+}
 
-  // We reset the modification time to "now" such that the pruning algorithm
-  // sees that the file should be kept over older files.
-  // On some systems the last accessed time is not automatically updated so set
-  // it explicitly here. Because the file will really only be accessed later
-  // during linking, it's not perfect but it's the best we can do.
-  {
-    int FD;
-    if (llvm::sys::fs::openFileForWrite(cacheFile.c_str(), FD,
-#if LDC_LLVM_VER >= 700
-                                        llvm::sys::fs::CD_OpenExisting,
-#endif
-                                        llvm::sys::fs::F_Append)) {
-      error(Loc(), "Failed to open the cached file for writing: %s",
-            cacheFile.c_str());
-      fatal();
-    }
+void recoverObjectFile(llvm::StringRef cacheObjectHash,
+                       llvm::StringRef objectFile) {
+  const auto start = std::chrono::steady_clock::now();
 
-    if (llvm::sys::fs::setLastModificationAndAccessTime(FD, getTimeNow())) {
-      error(Loc(), "Failed to set the cached file modification time: %s",
-            cacheFile.c_str());
-      fatal();
+  double codegenTime = -1;
+  if (!opts::cacheServer.empty()) {
+    client::recoverObjectFile(cacheObjectHash, objectFile, codegenTime);
+  } else {
+    recoverFromCacheDirectory(cacheObjectHash, objectFile, codegenTime);
+  }
+
+  if (!cacheStatsFile.empty()) {
+    const double recoveryTime = millisecondsSince(start);
+    uint64_t size = 0;
+    llvm::sys::fs::file_size(objectFile, size);
+    updateStats(cacheObjectHash, [&](CacheStats &s) {
+      s.objectFile = objectFile.str();
+      s.recoveryTime = recoveryTime;
+      s.bytesRestored = size;
+      s.codegenTime = codegenTime;
+    });
+  }
+}
+
+void writeStatistics() {
+  if (cacheStatsFile.empty())
+    return;
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(cacheStatsFile, ec, llvm::sys::fs::F_None);
+  if (ec) {
+    error(Loc(), "Cannot write cache statistics file '%s': %s",
+          cacheStatsFile.c_str(), ec.message().c_str());
+    return;
+  }
+
+  unsigned hits = 0, misses = 0;
+  double hashTime = 0, lookupTime = 0, recoveryTime = 0, timeSaved = 0;
+  uint64_t bytesRestored = 0;
+
+  os << "{\n  \"modules\": [";
+  bool first = true;
+  for (const auto &s : stats) {
+    os << (first ? "\n" : ",\n") << "    {\"object\": ";
+    first = false;
+    writeJSONString(os, s.objectFile);
+    os << ", \"hash\": \"" << s.hash << "\""
+       << ", \"fragment\": " << (s.isFragment ? "true" : "false")
+       << ", \"hit\": " << (s.hit ? "true" : "false")
+       << llvm::format(", \"hashTimeMs\": %.3f", s.hashTime)
+       << llvm::format(", \"lookupTimeMs\": %.3f", s.lookupTime);
+    if (s.hit) {
+      os << llvm::format(", \"recoveryTimeMs\": %.3f", s.recoveryTime)
+         << ", \"bytesRestored\": " << s.bytesRestored;
+      if (s.codegenTime >= 0)
+        os << llvm::format(", \"estimatedTimeSavedMs\": %.3f",
+                           s.codegenTime - s.recoveryTime);
+    } else if (s.codegenTime >= 0) {
+      os << llvm::format(", \"codegenTimeMs\": %.3f", s.codegenTime);
     }
+    os << "}";
 
-    close(FD);
+    (s.hit ? hits : misses)++;
+    hashTime += s.hashTime;
+    lookupTime += s.lookupTime;
+    if (s.hit) {
+      recoveryTime += s.recoveryTime;
+      bytesRestored += s.bytesRestored;
+      if (s.codegenTime >= 0)
+        timeSaved += s.codegenTime - s.recoveryTime;
+    }
   }
+  os << "\n  ],\n"
+     << "  \"hits\": " << hits << ",\n"
+     << "  \"misses\": " << misses << ",\n"
+     << llvm::format("  \"hashTimeMs\": %.3f,\n", hashTime)
+     << llvm::format("  \"lookupTimeMs\": %.3f,\n", lookupTime)
+     << llvm::format("  \"recoveryTimeMs\": %.3f,\n", recoveryTime)
+     << "  \"bytesRestored\": " << bytesRestored << ",\n"
+     << llvm::format("  \"estimatedTimeSavedMs\": %.3f\n", timeSaved)
+     << "}\n";
 }
 
 void pruneCache() {
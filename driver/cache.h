@@ -19,13 +19,26 @@ template <unsigned> class SmallString;
 
 namespace cache {
 
-void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str);
+/// Returns the cache directory or server socket, or an empty string if the
+/// IR-to-object cache is disabled.
+llvm::StringRef cacheLocation();
+
+/// Hashes the module together with the compiler version and all relevant
+/// commandline options. Fragments are hashed after optimization, so they use a
+/// separate key space.
+void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str,
+                         bool isFragment = false);
 std::string cacheLookup(llvm::StringRef cacheObjectHash);
+/// Adds the object file to the cache. `codegenTime` is the time in
+/// milliseconds spent on generating it, if known (see -cache-stats).
 void cacheObjectFile(llvm::StringRef objectFile,
-                     llvm::StringRef cacheObjectHash);
+                     llvm::StringRef cacheObjectHash, double codegenTime = -1);
 void recoverObjectFile(llvm::StringRef cacheObjectHash,
                        llvm::StringRef objectFile);
 
+/// Writes the -cache-stats report, if requested.
+void writeStatistics();
+
 /// Prune the cache to avoid filling up disk space.
 void pruneCache();
 }
@@ -0,0 +1,265 @@
+//===-- cache_client.cpp --------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Each lookup uses a separate connection, as modules may be written by several
+// backend threads concurrently. After a miss, the connection is kept open until
+// the object has been stored, which is how the server knows that this process
+// is still generating it.
+//
+// An unreachable server only disables the cache: the failure is logged, and
+// the modules are compiled as without a cache.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/cache_client.h"
+
+#include "dmd/errors.h"
+#include "driver/cl_options.h"
+#include "gen/logger.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <mutex>
+
+#if LDC_POSIX
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+class Connection {
+#if LDC_POSIX
+  int fd = -1;
+#endif
+
+public:
+  Connection() {
+#if LDC_POSIX
+    const std::string &path = opts::cacheServer;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+      IF_LOG Logger::println("Cache server socket path is too long: %s",
+                             path.c_str());
+      return;
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))) {
+      IF_LOG Logger::println("Failed to connect to cache server %s: %s",
+                             path.c_str(), strerror(errno));
+      if (fd != -1)
+        close(fd);
+      fd = -1;
+      return;
+    }
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+#else
+    error(Loc(), "-cache-server is only supported on POSIX systems");
+    fatal();
+#endif
+  }
+
+#if LDC_POSIX
+  ~Connection() {
+    if (fd != -1)
+      close(fd);
+  }
+
+  bool isConnected() const { return fd != -1; }
+
+  bool send(llvm::StringRef data) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (!data.empty()) {
+      const ssize_t n = ::send(fd, data.data(), data.size(), flags);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data = data.drop_front(n);
+    }
+    return true;
+  }
+
+  bool receive(char *data, size_t size) {
+    while (size) {
+      const ssize_t n = ::recv(fd, data, size, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  bool receiveLine(std::string &line) {
+    line.clear();
+    char c;
+    while (line.size() < 64) {
+      if (!receive(&c, 1))
+        return false;
+      if (c == '\n')
+        return true;
+      line += c;
+    }
+    return false;
+  }
+#else
+  bool isConnected() const { return false; }
+  bool send(llvm::StringRef) { return false; }
+  bool receive(char *, size_t) { return false; }
+  bool receiveLine(std::string &) { return false; }
+#endif
+};
+
+struct ReceivedObject {
+  std::string data;
+  double codegenTime;
+};
+
+std::mutex mutex;
+// Objects received from the server, until written to the output file.
+llvm::StringMap<ReceivedObject> receivedObjects;
+// Connections of lookups that missed, to store the generated object.
+llvm::StringMap<std::unique_ptr<Connection>> pendingStores;
+
+} // anonymous namespace
+
+namespace cache {
+namespace client {
+
+bool lookup(llvm::StringRef cacheObjectHash) {
+  std::unique_ptr<Connection> connection(new Connection());
+  if (!connection->isConnected())
+    return false;
+
+  std::string response;
+  if (!connection->send(("GET " + cacheObjectHash + "\n").str()) ||
+      !connection->receiveLine(response)) {
+    IF_LOG Logger::println("Lost connection to cache server.");
+    return false;
+  }
+
+  if (response == "MISS") {
+    IF_LOG Logger::println("Cache object not found.");
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingStores[cacheObjectHash] = std::move(connection);
+    return false;
+  }
+
+  unsigned long long size;
+  double codegenTime;
+  if (sscanf(response.c_str(), "HIT %llu %lf", &size, &codegenTime) != 2) {
+    IF_LOG Logger::println("Unexpected cache server response: %s",
+                           response.c_str());
+    return false;
+  }
+
+  std::string object(size, '\0');
+  if (!connection->receive(&object[0], size)) {
+    IF_LOG Logger::println("Lost connection to cache server.");
+    return false;
+  }
+
+  IF_LOG Logger::println("Cache object found! %llu bytes from %s", size,
+                         opts::cacheServer.c_str());
+  std::lock_guard<std::mutex> lock(mutex);
+  receivedObjects[cacheObjectHash] = {std::move(object), codegenTime};
+  return true;
+}
+
+void recoverObjectFile(llvm::StringRef cacheObjectHash,
+                       llvm::StringRef objectFile, double &codegenTime) {
+  ReceivedObject object;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = receivedObjects.find(cacheObjectHash);
+    assert(it != receivedObjects.end() && "object has not been looked up");
+    object = std::move(it->second);
+    receivedObjects.erase(it);
+  }
+  codegenTime = object.codegenTime;
+
+  IF_LOG Logger::println("Write object file received from cache server: %s",
+                         objectFile.str().c_str());
+  std::error_code ec;
+  llvm::raw_fd_ostream os(objectFile, ec, llvm::sys::fs::F_None);
+  if (!ec) {
+    os << object.data;
+    os.close();
+    ec = os.error();
+    os.clear_error();
+  }
+  if (ec) {
+    error(Loc(), "Failed to write the cached object file %s: %s",
+          objectFile.str().c_str(), ec.message().c_str());
+    fatal();
+  }
+}
+
+void cacheObjectFile(llvm::StringRef objectFile,
+                     llvm::StringRef cacheObjectHash, double codegenTime) {
+  std::unique_ptr<Connection> connection;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pendingStores.find(cacheObjectHash);
+    if (it != pendingStores.end()) {
+      connection = std::move(it->second);
+      pendingStores.erase(it);
+    }
+  }
+  if (!connection)
+    connection.reset(new Connection());
+  if (!connection->isConnected())
+    return;
+
+  auto bufferOrErr = llvm::MemoryBuffer::getFile(
+      objectFile, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (!bufferOrErr) {
+    error(Loc(), "Failed to read object file for the cache: %s",
+          objectFile.str().c_str());
+    fatal();
+  }
+  const llvm::StringRef object = bufferOrErr.get()->getBuffer();
+
+  IF_LOG Logger::println("Send object file to cache server: %s (%llu bytes)",
+                         objectFile.str().c_str(),
+                         static_cast<unsigned long long>(object.size()));
+  std::string response;
+  llvm::SmallString<64> request;
+  llvm::raw_svector_ostream(request)
+      << "PUT " << cacheObjectHash << ' ' << object.size() << ' '
+      << llvm::format("%.3f", codegenTime) << '\n';
+  if (!connection->send(request) ||
+      !connection->send(object) || !connection->receiveLine(response) ||
+      response != "OK") {
+    IF_LOG Logger::println("Failed to store object in cache server.");
+  }
+}
+}
+}
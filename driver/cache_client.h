@@ -0,0 +1,38 @@
+//===-- driver/cache_client.h - Cache server client -------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Client side of the ldc-cache-server protocol (see tools/ldc-cache-server.d),
+// used instead of the cache directory with -cache-server=<socket>.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace llvm {
+class StringRef;
+}
+
+namespace cache {
+namespace client {
+
+/// Asks the server for the object. Returns true if it has been received.
+/// Upon a miss, the server waits for this process to store the object; if
+/// another process is already generating it, this blocks until it is stored.
+bool lookup(llvm::StringRef cacheObjectHash);
+
+/// Writes the object received by a previous successful lookup, and returns
+/// the codegen time (in ms, negative if unknown) stored with it.
+void recoverObjectFile(llvm::StringRef cacheObjectHash,
+                       llvm::StringRef objectFile, double &codegenTime);
+
+/// Sends the object file and the time spent generating it to the server.
+void cacheObjectFile(llvm::StringRef objectFile,
+                     llvm::StringRef cacheObjectHash, double codegenTime);
+}
+}
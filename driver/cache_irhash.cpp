@@ -0,0 +1,610 @@
+//===-- cache_irhash.cpp --------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The module is walked once; types, constants and metadata nodes are written
+// on first use and referred to by a sequential ID afterwards, local values by
+// their position in the function. Instruction state not reachable via the
+// operands (alignment, atomic ordering, call attributes, ...) is written
+// explicitly; instructions without dedicated handling are printed.
+//
+// Debug info nodes keep some of their fields inline instead of as operands.
+// Those of the common kinds (locations, expressions, types, subprograms,
+// variables, ...) are written explicitly; other nodes are printed, referring
+// to other metadata by slot number.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/cache_irhash.h"
+
+#include "gen/attributes.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+template <typename T> unsigned getSyncScope(const T *i) {
+#if LDC_LLVM_VER >= 500
+  return i->getSyncScopeID();
+#else
+  return i->getSynchScope();
+#endif
+}
+
+class IRStructureWriter {
+  raw_ostream &os;
+  const Module &module;
+  ModuleSlotTracker slotTracker;
+  bool functionIncorporated = false;
+  SmallVector<StringRef, 16> mdKindNames;
+
+  DenseMap<const Type *, unsigned> typeIDs;
+  DenseMap<const Constant *, unsigned> constantIDs;
+  DenseMap<const Metadata *, unsigned> metadataIDs;
+  DenseMap<const GlobalValue *, unsigned> globalIDs;
+  // Arguments, basic blocks and instructions of the current function.
+  DenseMap<const Value *, unsigned> localIDs;
+
+  enum Tag : uint64_t { NullTag, BackRefTag, DefinitionTag };
+
+  void writeInt(uint64_t v) {
+    os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  void writeString(StringRef s) {
+    writeInt(s.size());
+    os << s;
+  }
+
+  void writeAPInt(const APInt &v) {
+    writeInt(v.getBitWidth());
+    for (unsigned i = 0, e = v.getNumWords(); i != e; ++i)
+      writeInt(v.getRawData()[i]);
+  }
+
+  /// Writes a back-reference and returns false if the entity has been written
+  /// before. Otherwise assigns it the next ID and returns true.
+  template <typename T>
+  bool enter(DenseMap<const T *, unsigned> &ids, const T *ptr) {
+    auto it = ids.insert(std::make_pair(ptr, ids.size()));
+    if (!it.second) {
+      writeInt(BackRefTag);
+      writeInt(it.first->second);
+      return false;
+    }
+    writeInt(DefinitionTag);
+    return true;
+  }
+
+  void writeType(const Type *t) {
+    if (!enter(typeIDs, t))
+      return;
+
+    writeInt(t->getTypeID());
+    switch (t->getTypeID()) {
+    case Type::IntegerTyID:
+      writeInt(t->getIntegerBitWidth());
+      break;
+    case Type::FunctionTyID:
+      writeInt(cast<FunctionType>(t)->isVarArg());
+      break;
+    case Type::StructTyID: {
+      auto st = cast<StructType>(t);
+      writeString(st->hasName() ? st->getName() : "");
+      writeInt(st->isPacked());
+      writeInt(st->isOpaque());
+      break;
+    }
+    case Type::ArrayTyID:
+      writeInt(t->getArrayNumElements());
+      break;
+    case Type::VectorTyID:
+      writeInt(t->getVectorNumElements());
+      break;
+    case Type::PointerTyID:
+      writeInt(t->getPointerAddressSpace());
+      break;
+    default:
+      break;
+    }
+
+    writeInt(t->getNumContainedTypes());
+    for (const Type *sub : t->subtypes())
+      writeType(sub);
+  }
+
+  void writeValue(const Value *v) {
+    if (!v) {
+      writeInt(NullTag);
+      return;
+    }
+
+    if (auto gv = dyn_cast<GlobalValue>(v)) {
+      writeInt('G');
+      writeInt(globalIDs.lookup(gv));
+    } else if (auto c = dyn_cast<Constant>(v)) {
+      writeInt('C');
+      writeConstant(c);
+    } else if (auto mdv = dyn_cast<MetadataAsValue>(v)) {
+      writeInt('M');
+      writeMetadata(mdv->getMetadata());
+    } else if (auto ia = dyn_cast<InlineAsm>(v)) {
+      writeInt('A');
+      writeType(ia->getFunctionType());
+      writeString(ia->getAsmString());
+      writeString(ia->getConstraintString());
+      writeInt(ia->hasSideEffects());
+      writeInt(ia->isAlignStack());
+      writeInt(ia->getDialect());
+    } else {
+      auto it = localIDs.find(v);
+      assert(it != localIDs.end() && "unexpected kind of value");
+      writeInt('L');
+      writeInt(it->second);
+    }
+  }
+
+  void writeConstant(const Constant *c) {
+    if (!enter(constantIDs, c))
+      return;
+
+    writeInt(c->getValueID());
+    writeType(c->getType());
+
+    if (auto ci = dyn_cast<ConstantInt>(c)) {
+      writeAPInt(ci->getValue());
+      return;
+    }
+    if (auto cfp = dyn_cast<ConstantFP>(c)) {
+      writeAPInt(cfp->getValueAPF().bitcastToAPInt());
+      return;
+    }
+    if (auto cds = dyn_cast<ConstantDataSequential>(c)) {
+      writeString(cds->getRawDataValues());
+      return;
+    }
+    if (auto ba = dyn_cast<BlockAddress>(c)) {
+      writeValue(ba->getFunction());
+      unsigned index = 0;
+      for (const BasicBlock &bb : *ba->getFunction()) {
+        if (&bb == ba->getBasicBlock())
+          break;
+        ++index;
+      }
+      writeInt(index);
+      return;
+    }
+    if (auto ce = dyn_cast<ConstantExpr>(c)) {
+      writeInt(ce->getOpcode());
+      // inbounds, inrange, nsw, nuw, exact
+      writeInt(ce->getRawSubclassOptionalData());
+      if (ce->isCompare())
+        writeInt(ce->getPredicate());
+      if (ce->hasIndices()) {
+        writeInt(ce->getIndices().size());
+        for (unsigned index : ce->getIndices())
+          writeInt(index);
+      }
+      if (auto gep = dyn_cast<GEPOperator>(ce))
+        writeType(gep->getSourceElementType());
+    }
+
+    writeInt(c->getNumOperands());
+    for (const Use &op : c->operands())
+      writeValue(op.get());
+  }
+
+  /// Writes the inline fields of the common debug info nodes, whose other
+  /// fields are operands. Returns false for other kinds of nodes.
+  bool writeDINodeFields(const MDNode *node) {
+    if (auto loc = dyn_cast<DILocation>(node)) {
+      writeInt(loc->getLine());
+      writeInt(loc->getColumn());
+    } else if (auto expr = dyn_cast<DIExpression>(node)) {
+      writeInt(expr->getNumElements());
+      for (uint64_t element : expr->getElements())
+        writeInt(element);
+    } else if (auto type = dyn_cast<DIType>(node)) {
+      writeInt(type->getTag());
+      writeInt(type->getLine());
+      writeInt(type->getSizeInBits());
+      writeInt(type->getAlignInBits());
+      writeInt(type->getOffsetInBits());
+      writeInt(type->getFlags());
+      if (auto basic = dyn_cast<DIBasicType>(type)) {
+        writeInt(basic->getEncoding());
+      } else if (auto composite = dyn_cast<DICompositeType>(type)) {
+        writeInt(composite->getRuntimeLang());
+#if LDC_LLVM_VER >= 400
+      } else if (auto subroutine = dyn_cast<DISubroutineType>(type)) {
+        writeInt(subroutine->getCC());
+#endif
+#if LDC_LLVM_VER >= 500
+      } else if (auto derived = dyn_cast<DIDerivedType>(type)) {
+        const auto addressSpace = derived->getDWARFAddressSpace();
+        writeInt(addressSpace ? *addressSpace + 1 : 0);
+#endif
+      }
+    } else if (auto sp = dyn_cast<DISubprogram>(node)) {
+      writeInt(sp->getLine());
+      writeInt(sp->getScopeLine());
+      writeInt(sp->getVirtuality());
+      writeInt(sp->getVirtualIndex());
+      writeInt(sp->getFlags());
+      writeInt(sp->isLocalToUnit());
+      writeInt(sp->isDefinition());
+      writeInt(sp->isOptimized());
+#if LDC_LLVM_VER >= 400
+      writeInt(sp->getThisAdjustment());
+#endif
+    } else if (auto var = dyn_cast<DILocalVariable>(node)) {
+      writeInt(var->getLine());
+      writeInt(var->getArg());
+      writeInt(var->getFlags());
+#if LDC_LLVM_VER >= 400
+      writeInt(var->getAlignInBits());
+#endif
+    } else if (auto var = dyn_cast<DIGlobalVariable>(node)) {
+      writeInt(var->getLine());
+      writeInt(var->isLocalToUnit());
+      writeInt(var->isDefinition());
+#if LDC_LLVM_VER >= 400
+      writeInt(var->getAlignInBits());
+#endif
+    } else if (auto block = dyn_cast<DILexicalBlock>(node)) {
+      writeInt(block->getLine());
+      writeInt(block->getColumn());
+    } else if (auto blockFile = dyn_cast<DILexicalBlockFile>(node)) {
+      writeInt(blockFile->getDiscriminator());
+    } else if (auto imported = dyn_cast<DIImportedEntity>(node)) {
+      writeInt(imported->getTag());
+      writeInt(imported->getLine());
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  void writeMetadata(const Metadata *md) {
+    if (!md) {
+      writeInt(NullTag);
+      return;
+    }
+    if (!enter(metadataIDs, md))
+      return;
+
+    writeInt(md->getMetadataID());
+    if (auto s = dyn_cast<MDString>(md)) {
+      writeString(s->getString());
+      return;
+    }
+    if (auto vam = dyn_cast<ValueAsMetadata>(md)) {
+      writeValue(vam->getValue());
+      return;
+    }
+
+    auto node = cast<MDNode>(md);
+    writeInt(node->isDistinct());
+    if (!isa<MDTuple>(node) && !writeDINodeFields(node)) {
+      // The slot tracker numbers all metadata nodes of the module, so that
+      // operands are printed by slot (e.g. a function's DISubprogram before
+      // the function is incorporated), not by address.
+      SmallString<256> str;
+      raw_svector_ostream strOS(str);
+      node->print(strOS, slotTracker, &module);
+      assert(str.find("<0x") == StringRef::npos &&
+             "metadata printed by address");
+      writeString(str);
+    }
+
+    writeInt(node->getNumOperands());
+    for (const MDOperand &op : node->operands())
+      writeMetadata(op.get());
+  }
+
+  void writeMetadataAttachments(
+      const SmallVectorImpl<std::pair<unsigned, MDNode *>> &mds) {
+    writeInt(mds.size());
+    for (const auto &md : mds) {
+      writeString(md.first < mdKindNames.size() ? mdKindNames[md.first] : "");
+      writeMetadata(md.second);
+    }
+  }
+
+  void writeAttributes(const LLAttributeSet &attrs, unsigned numArgs) {
+    writeString(attrs.getAsString(LLAttributeSet::FunctionIndex));
+    writeString(attrs.getAsString(LLAttributeSet::ReturnIndex));
+    writeInt(numArgs);
+    for (unsigned i = 0; i < numArgs; ++i)
+      writeString(attrs.getAsString(AttrSet::FirstArgIndex + i));
+  }
+
+  template <typename CallOrInvoke>
+  void writeCallSpecifics(const CallOrInvoke *call) {
+    writeType(call->getFunctionType());
+    writeInt(call->getCallingConv());
+    writeAttributes(call->getAttributes(), call->getNumArgOperands());
+    writeInt(call->getNumOperandBundles());
+    for (unsigned i = 0, e = call->getNumOperandBundles(); i != e; ++i) {
+      const auto bundle = call->getOperandBundleAt(i);
+      writeString(bundle.getTagName());
+      writeInt(bundle.Inputs.size());
+    }
+  }
+
+  void writeInstruction(const Instruction &i) {
+    writeInt(i.getOpcode());
+    writeType(i.getType());
+    // nsw, nuw, exact, inbounds, fast-math flags
+    writeInt(i.getRawSubclassOptionalData());
+    writeInt(i.getNumOperands());
+    for (const Use &op : i.operands())
+      writeValue(op.get());
+
+    switch (i.getOpcode()) {
+    case Instruction::Alloca: {
+      auto ai = cast<AllocaInst>(&i);
+      writeType(ai->getAllocatedType());
+      writeInt(ai->getAlignment());
+      writeInt(ai->isUsedWithInAlloca());
+      writeInt(ai->isSwiftError());
+      break;
+    }
+    case Instruction::Load: {
+      auto li = cast<LoadInst>(&i);
+      writeInt(li->isVolatile());
+      writeInt(li->getAlignment());
+      writeInt(static_cast<unsigned>(li->getOrdering()));
+      writeInt(getSyncScope(li));
+      break;
+    }
+    case Instruction::Store: {
+      auto si = cast<StoreInst>(&i);
+      writeInt(si->isVolatile());
+      writeInt(si->getAlignment());
+      writeInt(static_cast<unsigned>(si->getOrdering()));
+      writeInt(getSyncScope(si));
+      break;
+    }
+    case Instruction::Fence: {
+      auto fi = cast<FenceInst>(&i);
+      writeInt(static_cast<unsigned>(fi->getOrdering()));
+      writeInt(getSyncScope(fi));
+      break;
+    }
+    case Instruction::AtomicCmpXchg: {
+      auto cxi = cast<AtomicCmpXchgInst>(&i);
+      writeInt(cxi->isVolatile());
+      writeInt(cxi->isWeak());
+      writeInt(static_cast<unsigned>(cxi->getSuccessOrdering()));
+      writeInt(static_cast<unsigned>(cxi->getFailureOrdering()));
+      writeInt(getSyncScope(cxi));
+      break;
+    }
+    case Instruction::AtomicRMW: {
+      auto rmwi = cast<AtomicRMWInst>(&i);
+      writeInt(rmwi->getOperation());
+      writeInt(rmwi->isVolatile());
+      writeInt(static_cast<unsigned>(rmwi->getOrdering()));
+      writeInt(getSyncScope(rmwi));
+      break;
+    }
+    case Instruction::GetElementPtr:
+      writeType(cast<GetElementPtrInst>(&i)->getSourceElementType());
+      break;
+    case Instruction::ICmp:
+    case Instruction::FCmp:
+      writeInt(cast<CmpInst>(&i)->getPredicate());
+      break;
+    case Instruction::PHI: {
+      auto phi = cast<PHINode>(&i);
+      for (const BasicBlock *bb : phi->blocks())
+        writeValue(bb);
+      break;
+    }
+    case Instruction::Call: {
+      auto ci = cast<CallInst>(&i);
+      writeInt(ci->getTailCallKind());
+      writeCallSpecifics(ci);
+      break;
+    }
+    case Instruction::Invoke:
+      writeCallSpecifics(cast<InvokeInst>(&i));
+      break;
+    case Instruction::ExtractValue:
+      for (unsigned index : cast<ExtractValueInst>(&i)->indices())
+        writeInt(index);
+      break;
+    case Instruction::InsertValue:
+      for (unsigned index : cast<InsertValueInst>(&i)->indices())
+        writeInt(index);
+      break;
+    case Instruction::LandingPad: {
+      auto lpi = cast<LandingPadInst>(&i);
+      writeInt(lpi->isCleanup());
+      for (unsigned c = 0, e = lpi->getNumClauses(); c != e; ++c)
+        writeInt(lpi->isCatch(c));
+      break;
+    }
+    // Fully described by their operands and type.
+    case Instruction::Ret:
+    case Instruction::Br:
+    case Instruction::Switch:
+    case Instruction::IndirectBr:
+    case Instruction::Resume:
+    case Instruction::Unreachable:
+    case Instruction::CleanupRet:
+    case Instruction::CatchRet:
+    case Instruction::CatchSwitch:
+    case Instruction::CatchPad:
+    case Instruction::CleanupPad:
+    case Instruction::Select:
+    case Instruction::ExtractElement:
+    case Instruction::InsertElement:
+    case Instruction::ShuffleVector:
+    case Instruction::VAArg:
+      break;
+    default:
+      if (i.isBinaryOp() || i.isCast())
+        break;
+      if (!functionIncorporated) {
+        slotTracker.incorporateFunction(*i.getFunction());
+        functionIncorporated = true;
+      }
+      i.print(os, slotTracker);
+      break;
+    }
+
+    if (const DebugLoc &loc = i.getDebugLoc()) {
+      writeMetadata(loc.get());
+    } else {
+      writeInt(NullTag);
+    }
+    SmallVector<std::pair<unsigned, MDNode *>, 4> mds;
+    i.getAllMetadataOtherThanDebugLoc(mds);
+    writeMetadataAttachments(mds);
+  }
+
+  void writeGlobalValue(const GlobalValue &gv) {
+    writeString(gv.getName());
+    writeInt(gv.getValueID());
+    writeType(gv.getType());
+    writeType(gv.getValueType());
+    writeInt(gv.getLinkage());
+    writeInt(gv.getVisibility());
+    writeInt(gv.getDLLStorageClass());
+    writeInt(static_cast<unsigned>(gv.getUnnamedAddr()));
+    writeInt(gv.getThreadLocalMode());
+#if LDC_LLVM_VER >= 600
+    writeInt(gv.isDSOLocal());
+#endif
+
+    if (auto go = dyn_cast<GlobalObject>(&gv)) {
+      writeInt(go->getAlignment());
+      writeString(go->getSection());
+      if (const Comdat *c = go->getComdat()) {
+        writeString(c->getName());
+        writeInt(c->getSelectionKind());
+      } else {
+        writeInt(NullTag);
+      }
+      SmallVector<std::pair<unsigned, MDNode *>, 4> mds;
+      go->getAllMetadata(mds);
+      writeMetadataAttachments(mds);
+    }
+  }
+
+  void writeFunctionBody(const Function &f) {
+    localIDs.clear();
+    functionIncorporated = false;
+
+    unsigned id = 0;
+    for (const Argument &arg : f.args())
+      localIDs[&arg] = id++;
+    for (const BasicBlock &bb : f) {
+      localIDs[&bb] = id++;
+      for (const Instruction &i : bb)
+        localIDs[&i] = id++;
+    }
+
+    writeInt(id);
+    for (const BasicBlock &bb : f) {
+      writeInt(bb.size());
+      for (const Instruction &i : bb)
+        writeInstruction(i);
+    }
+  }
+
+public:
+  IRStructureWriter(const Module &m, raw_ostream &os)
+      : os(os), module(m),
+        slotTracker(&m, /*ShouldInitializeAllMetadata=*/true) {
+    m.getContext().getMDKindNames(mdKindNames);
+
+    // Globals may be referenced before their definition.
+    for (const GlobalValue &gv : m.globals())
+      globalIDs.insert(std::make_pair(&gv, globalIDs.size()));
+    for (const GlobalValue &gv : m)
+      globalIDs.insert(std::make_pair(&gv, globalIDs.size()));
+    for (const GlobalValue &gv : m.aliases())
+      globalIDs.insert(std::make_pair(&gv, globalIDs.size()));
+    for (const GlobalValue &gv : m.ifuncs())
+      globalIDs.insert(std::make_pair(&gv, globalIDs.size()));
+  }
+
+  void write() {
+    writeString(module.getTargetTriple());
+    writeString(module.getDataLayoutStr());
+    writeString(module.getSourceFileName());
+    writeString(module.getModuleInlineAsm());
+
+    writeInt(module.getGlobalList().size());
+    for (const GlobalVariable &gv : module.globals()) {
+      writeGlobalValue(gv);
+      writeInt(gv.isConstant());
+      writeInt(gv.isExternallyInitialized());
+#if LDC_LLVM_VER >= 500
+      writeString(gv.getAttributes().getAsString());
+#endif
+      writeValue(gv.hasInitializer() ? gv.getInitializer() : nullptr);
+    }
+
+    writeInt(module.getFunctionList().size());
+    for (const Function &f : module) {
+      writeGlobalValue(f);
+      writeInt(f.getCallingConv());
+      writeAttributes(f.getAttributes(), f.arg_size());
+      writeString(f.hasGC() ? f.getGC() : "");
+      writeValue(f.hasPersonalityFn() ? f.getPersonalityFn() : nullptr);
+      writeValue(f.hasPrefixData() ? f.getPrefixData() : nullptr);
+      writeValue(f.hasPrologueData() ? f.getPrologueData() : nullptr);
+      writeInt(f.isDeclaration());
+      if (!f.isDeclaration())
+        writeFunctionBody(f);
+    }
+
+    writeInt(module.getAliasList().size());
+    for (const GlobalAlias &ga : module.aliases()) {
+      writeGlobalValue(ga);
+      writeValue(ga.getAliasee());
+    }
+
+    writeInt(module.getIFuncList().size());
+    for (const GlobalIFunc &gi : module.ifuncs()) {
+      writeGlobalValue(gi);
+      writeValue(gi.getResolver());
+    }
+
+    // Incl. module flags and linker options.
+    for (const NamedMDNode &nmd : module.named_metadata()) {
+      writeString(nmd.getName());
+      writeInt(nmd.getNumOperands());
+      for (const MDNode *op : nmd.operands())
+        writeMetadata(op);
+    }
+  }
+};
+
+} // anonymous namespace
+
+namespace cache {
+
+void streamModuleStructure(const llvm::Module &m, llvm::raw_ostream &os) {
+  IRStructureWriter(m, os).write();
+}
+}
@@ -0,0 +1,27 @@
+//===-- driver/cache_irhash.h - Structural LLVM IR hashing ------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Streams a canonical description of an LLVM module's structure, to be hashed
+// for the IR-to-object cache without serializing the module to bitcode.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+namespace llvm {
+class Module;
+class raw_ostream;
+}
+
+namespace cache {
+
+/// Writes everything that may influence the code generated for the module to
+/// `os`, in a compact binary form. Identical modules yield identical streams.
+void streamModuleStructure(const llvm::Module &m, llvm::raw_ostream &os);
+}
@@ -14,3 +14,6 @@
 void pruneCache(const char *cacheDirectoryPtr, d_size_t cacheDirectoryLen,
                 uint32_t pruneIntervalSeconds, uint32_t expireIntervalSeconds,
                 uinteger_t sizeLimitBytes, uint32_t sizeLimitPercentage);
+
+void compactCacheIndex(const char *cacheDirectoryPtr,
+                       d_size_t cacheDirectoryLen);
@@ -228,6 +228,12 @@ cl::opt<std::string>
                       "store cache files (experimental)"),
              cl::value_desc("cache dir"), cl::ZeroOrMore);
 
+cl::opt<std::string> cacheServer(
+    "cache-server",
+    cl::desc("Enable compilation cache, using the ldc-cache-server listening "
+             "on <socket> instead of a cache directory (experimental)"),
+    cl::value_desc("socket"), cl::ZeroOrMore);
+
 static StringsAdapter strImpPathStore("J", global.params.fileImppath);
 static cl::list<std::string, StringsAdapter> stringImportPaths(
     "J", cl::desc("Look for string imports also in <directory>"),
@@ -367,6 +373,16 @@ cl::opt<bool, true>
     singleObj("singleobj", cl::desc("Create only a single output object file"),
               cl::ZeroOrMore, cl::location(global.params.oneobj));
 
+cl::opt<unsigned> codegenThreads(
+    "j", cl::ZeroOrMore, cl::value_desc("N"), cl::init(1),
+    cl::desc("Read and parse up to <N> source files and optimize and write "
+             "up to <N> modules in parallel; with -singleobj, split the "
+             "optimized module into <N> partitions for parallel machine "
+             "codegen if gcc (or -gcc) is available for merging their "
+             "object files (0: use all hardware threads); with more than one "
+             "thread, -output-s assembly is generated concurrently with the "
+             "object file"));
+
 cl::opt<uint32_t, true> hashThreshold(
     "hash-threshold", cl::ZeroOrMore, cl::location(global.params.hashThreshold),
     cl::desc("Hash symbol names longer than this threshold (experimental)"));
@@ -443,6 +459,55 @@ cl::opt<std::string>
                            cl::ValueOptional);
 #endif
 
+cl::opt<std::string> memoryReportFile(
+    "memory-report", cl::ZeroOrMore, cl::value_desc("filename"),
+    cl::desc("Write a JSON file with the memory allocated per compilation "
+             "phase, the frontend's class instance counts, the sizes of the "
+             "LLVM modules and the CTFE heap usage"));
+
+cl::opt<bool> timeTrace(
+    "ftime-trace", cl::ZeroOrMore,
+    cl::desc("Write a Chrome trace JSON file with the time spent in the "
+             "compilation phases, CTFE calls, template instantiations, LLVM "
+             "passes and machine codegen (see chrome://tracing)"));
+
+cl::opt<unsigned> timeTraceGranularity(
+    "ftime-trace-granularity", cl::ZeroOrMore, cl::value_desc("us"),
+    cl::init(500),
+    cl::desc("Minimum duration of the spans recorded by -ftime-trace in "
+             "microseconds (default: 500)"));
+
+cl::opt<std::string> timeTraceFile(
+    "ftime-trace-file", cl::ZeroOrMore, cl::value_desc("filename"),
+    cl::desc("Output file of -ftime-trace (default: the output file name with "
+             "extension .time-trace)"));
+
+cl::opt<unsigned> lexerBenchmark(
+    "lexer-benchmark", cl::ZeroOrMore, cl::value_desc("iterations"),
+    cl::Hidden,
+    cl::desc("Instead of compiling, lex the source files <iterations> times "
+             "with and without the word-wise fast paths, check that both "
+             "yield the same tokens and print the throughputs"));
+
+static cl::opt<bool, true> ctfeBytecode(
+    "ctfe-bytecode", cl::ZeroOrMore,
+    cl::location(global.params.ctfeBytecode),
+    cl::desc("Compile CTFE'd functions to bytecode and run them on a register "
+             "VM, falling back to the AST interpreter for unsupported code"));
+
+static cl::opt<bool, true> ctfeRegion(
+    "ctfe-region", cl::ZeroOrMore, cl::location(global.params.ctfeRegion),
+    cl::init(false),
+    cl::desc("Allocate the values created by CTFE from a region released "
+             "after each top-level evaluation (default: false)"));
+
+// Only checked for by driver/main.d, before the command line is parsed.
+static cl::opt<bool>
+    lowmem("lowmem", cl::ZeroOrMore,
+           cl::desc("Enable the garbage collector for the frontend, reducing "
+                    "the memory requirements at the cost of compile time "
+                    "(only recognized directly on the command line)"));
+
 #if LDC_LLVM_SUPPORTED_TARGET_SPIRV || LDC_LLVM_SUPPORTED_TARGET_NVPTX
 cl::list<std::string>
     dcomputeTargets("mdcompute-targets", cl::CommaSeparated,
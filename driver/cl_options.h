@@ -66,6 +66,8 @@ extern cl::list<std::string> versions;
 extern cl::list<std::string> transitions;
 extern cl::opt<std::string> moduleDeps;
 extern cl::opt<std::string> cacheDir;
+extern cl::opt<std::string> cacheServer;
+extern cl::opt<unsigned> codegenThreads;
 extern cl::list<std::string> linkerSwitches;
 extern cl::list<std::string> ccSwitches;
 extern cl::list<std::string> includeModulePatterns;
@@ -106,6 +108,11 @@ inline bool isUsingThinLTO() { return ltoMode == LTO_Thin; }
 #if LDC_LLVM_VER >= 400
 extern cl::opt<std::string> saveOptimizationRecord;
 #endif
+extern cl::opt<std::string> memoryReportFile;
+extern cl::opt<bool> timeTrace;
+extern cl::opt<unsigned> timeTraceGranularity;
+extern cl::opt<std::string> timeTraceFile;
+extern cl::opt<unsigned> lexerBenchmark;
 #if LDC_LLVM_SUPPORTED_TARGET_SPIRV || LDC_LLVM_SUPPORTED_TARGET_NVPTX
 extern cl::list<std::string> dcomputeTargets;
 extern cl::opt<std::string> dcomputeFilePrefix;
@@ -14,9 +14,12 @@
 #include "dmd/mars.h"
 #include "dmd/module.h"
 #include "dmd/scope.h"
+#include "driver/backendpool.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/linker.h"
+#include "driver/memory_report.h"
+#include "driver/timetrace.h"
 #include "driver/toobj.h"
 #include "gen/dynamiccompile.h"
 #include "gen/logger.h"
@@ -24,6 +27,7 @@
 #include "gen/runtime.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/YAMLTraits.h"
 
@@ -176,6 +180,10 @@ CodeGenerator::CodeGenerator(llvm::LLVMContext &context, bool singleObj)
   if (!global.params.output_ll) {
     context_.setDiscardValueNames(true);
   }
+
+  if (const unsigned numThreads = BackendPool::getNumThreads(singleObj)) {
+    backendPool_ = llvm::make_unique<BackendPool>(numThreads);
+  }
 }
 
 CodeGenerator::~CodeGenerator() {
@@ -190,6 +198,9 @@ CodeGenerator::~CodeGenerator() {
 
     writeAndFreeLLModule(filename);
   }
+
+  // Wait for the backend threads to finish writing all modules.
+  backendPool_.reset();
 }
 
 void CodeGenerator::prepareLLModule(Module *m) {
@@ -253,13 +264,46 @@ void CodeGenerator::writeAndFreeLLModule(const char *filename) {
   std::unique_ptr<llvm::ToolOutputFile> diagnosticsOutputFile =
       createAndSetDiagnosticsOutputFile(*ir_, context_, filename);
 
-  writeModule(&ir_->module, filename);
+  // For -memory-report, before the module is optimized.
+  const bool reportMemory = !opts::memoryReportFile.empty();
+  std::string moduleName;
+  size_t numGlobals = 0, numFunctions = 0, numBasicBlocks = 0,
+         numInstructions = 0;
+  if (reportMemory) {
+    moduleName = ir_->module.getModuleIdentifier();
+    numGlobals = ir_->module.global_size();
+    for (const auto &function : ir_->module) {
+      ++numFunctions;
+      for (const auto &bb : function) {
+        ++numBasicBlocks;
+        numInstructions += bb.size();
+      }
+    }
+  }
+
+  if (backendPool_) {
+    backendPool_->submit(ir_->module, filename);
+  } else {
+    writeModule(&ir_->module, filename);
+  }
 
   if (diagnosticsOutputFile)
     diagnosticsOutputFile->keep();
 
+  // Only approximates the size of the module, as the backend threads may
+  // allocate concurrently and the LLVMContext retains types and constants.
+  const size_t mallocUsage =
+      reportMemory ? llvm::sys::Process::GetMallocUsage() : 0;
   delete ir_;
   ir_ = nullptr;
+
+  if (reportMemory) {
+    const size_t newMallocUsage = llvm::sys::Process::GetMallocUsage();
+    addLLVMModuleToMemoryReport(
+        moduleName.c_str(), numGlobals, numFunctions, numBasicBlocks,
+        numInstructions,
+        mallocUsage > newMallocUsage ? mallocUsage - newMallocUsage : 0);
+  }
 }
 
 namespace {
@@ -288,6 +332,8 @@ void CodeGenerator::emit(Module *m) {
   IF_LOG Logger::println("CodeGenerator::emit(%s)", m->toPrettyChars());
   LOG_SCOPE;
 
+  TimeTraceScope timeScope("Emit module", m->toPrettyChars());
+
   if (global.params.verbose_cg) {
     printf("codegen: %s (%s)\n", m->toPrettyChars(), m->srcfile->toChars());
   }
@@ -20,9 +20,12 @@
 #pragma once
 
 #include "gen/irstate.h"
+#include <memory>
 
 namespace ldc {
 
+class BackendPool;
+
 class CodeGenerator {
 public:
   CodeGenerator(llvm::LLVMContext &context, bool singleObj);
@@ -38,5 +41,6 @@ private:
   int moduleCount_;
   bool const singleObj_;
   IRState *ir_;
+  std::unique_ptr<BackendPool> backendPool_;
 };
 }
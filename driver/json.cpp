@@ -0,0 +1,56 @@
+//===-- json.cpp ----------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/json.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstring>
+#include <string>
+
+void writeJSONString(llvm::raw_ostream &os, llvm::StringRef str) {
+  os << '"';
+  for (unsigned char c : str) {
+    switch (c) {
+    case '"':
+      os << "\\\"";
+      break;
+    case '\\':
+      os << "\\\\";
+      break;
+    case '\n':
+      os << "\\n";
+      break;
+    case '\r':
+      os << "\\r";
+      break;
+    case '\t':
+      os << "\\t";
+      break;
+    default:
+      if (c < 0x20)
+        os << llvm::format("\\u%04x", c);
+      else
+        os << c;
+    }
+  }
+  os << '"';
+}
+
+d_size_t formatJSONString(const char *str, d_size_t length, char *buffer,
+                          d_size_t bufferSize) {
+  std::string result;
+  llvm::raw_string_ostream os(result);
+  writeJSONString(os, llvm::StringRef(str, length));
+  os.flush();
+  if (result.size() <= bufferSize)
+    memcpy(buffer, result.data(), result.size());
+  return result.size();
+}
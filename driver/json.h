@@ -0,0 +1,30 @@
+//===-- driver/json.h - JSON output helpers ---------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Shared by the JSON reports (-ftime-trace, -cache-stats, -memory-report).
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "dmd/globals.h"
+
+namespace llvm {
+class raw_ostream;
+class StringRef;
+}
+
+/// Writes `str` as a quoted JSON string, escaping quotes, backslashes and
+/// control characters.
+void writeJSONString(llvm::raw_ostream &os, llvm::StringRef str);
+
+/// Formats `str` as by writeJSONString() into `buffer` if it fits, returning
+/// the length of the formatted string (for driver/memory_report.d).
+d_size_t formatJSONString(const char *str, d_size_t length, char *buffer,
+                          d_size_t bufferSize);
@@ -11,7 +11,8 @@
 // Wrapper allowing use of LDC as drop-in replacement for DMD.
 //
 // Most command-line options are passed through to LDC; some with different
-// names or semantics need to be translated.
+// names or semantics need to be translated. The LDC driver is linked into this
+// executable, so the translated command line is compiled in-process.
 //
 // DMD also reads switches from the DFLAGS enviroment variable, if present. This
 // is contrary to what C compilers do, where CFLAGS is usually handled by the
@@ -19,33 +20,23 @@
 //
 //===----------------------------------------------------------------------===//
 
-#ifndef LDC_EXE_NAME
-#error "Please define LDC_EXE_NAME to the name of the LDC executable to use."
-#endif
-
 #include "driver/exe_path.h"
-#include "llvm/ADT/SmallString.h"
-#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/SystemUtils.h"
-#include "llvm/Support/raw_ostream.h"
 #include <cassert>
 #include <cerrno>
 #include <climits>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
-#include <numeric>
 #include <vector>
 
 #if _WIN32
 #include <windows.h>
 #else
+#include <cstring>
 #include <sys/stat.h>
-#endif
-
-#ifdef HAVE_SC_ARG_MAX
 #include <unistd.h>
 #endif
 
@@ -58,6 +49,12 @@ int response_expand(size_t *pargc, char ***pargv);
 // in dmd/root/man.d
 void browse(const char *url);
 
+// in driver/main.d
+int ldcMain(int argc, char **argv);
+
+// The helpers below must not clash with the LDC driver linked into ldmd2.
+namespace {
+
 /**
  * Prints a formatted error message to stderr and exits the program.
  */
@@ -135,10 +132,12 @@ int execute(const std::string &exePath, const char **args) {
 /**
  * Prints usage information to stdout.
  */
-void printUsage(const char *argv0, const std::string &ldcPath) {
-  // Print version information by actually invoking ldc -version.
-  const char *args[] = {ldcPath.c_str(), "-version", nullptr};
-  execute(ldcPath, args);
+void printUsage(const char *argv0) {
+  // Print version information by invoking ourselves with --version; ldc
+  // -version exits the process after printing it.
+  const std::string &ldmdPath = exe_path::getExePath();
+  const char *args[] = {ldmdPath.c_str(), "--version", nullptr};
+  execute(ldmdPath, args);
 
   printf(
       "\n\
@@ -196,6 +195,7 @@ Where:\n\
   -J=<directory>   look for string imports also in directory\n\
   -L=<linkerflag>  pass linkerflag to link\n\
   -lib             generate library rather than object files\n\
+  -lowmem          enable garbage collection for the compiler\n\
   -m32             generate 32 bit code\n"
 #if 0
 "  -m32mscoff       generate 32 bit code and write MS-COFF object files\n"
@@ -350,7 +350,6 @@ void translateArgs(size_t originalArgc, char **originalArgv,
   }
 
   assert(ldcArgs.size() == 1);
-  const std::string ldcPath = ldcArgs[0];
 
   ldcArgs.push_back("-ldmd");
 
@@ -451,9 +450,8 @@ void translateArgs(size_t originalArgc, char **originalArgv,
           goto Lerror;
         }
       } else if (strcmp(p + 1, "mcpu=?") == 0) {
-        const char *mcpuargs[] = {ldcPath.c_str(), "-mcpu=help", nullptr};
-        execute(ldcPath, mcpuargs);
-        exit(EXIT_SUCCESS);
+        const char *mcpuargs[] = {ldcArgs[0], "-mcpu=help", nullptr};
+        exit(ldcMain(2, const_cast<char **>(mcpuargs)));
       } else if (strncmp(p + 1, "mcpu=", 5) == 0) {
         if (strcmp(p + 6, "baseline") == 0) {
           // ignore
@@ -467,9 +465,8 @@ void translateArgs(size_t originalArgc, char **originalArgv,
           goto Lerror;
         }
       } else if (strcmp(p + 1, "transition=?") == 0) {
-        const char *transitionargs[] = {ldcPath.c_str(), p, nullptr};
-        execute(ldcPath, transitionargs);
-        exit(EXIT_SUCCESS);
+        const char *transitionargs[] = {ldcArgs[0], p, nullptr};
+        exit(ldcMain(2, const_cast<char **>(transitionargs)));
       }
       /* -transition=<id>
        * -w
@@ -573,18 +570,17 @@ void translateArgs(size_t originalArgc, char **originalArgv,
                  strcmp(p + 1, "-x") == 0 || strcmp(p + 1, "-y") == 0) {
         ldcArgs.push_back(concat("-hidden-debug-", p + 2));
       } else if (strcmp(p + 1, "-help") == 0 || strcmp(p + 1, "h") == 0) {
-        printUsage(originalArgv[0], ldcPath);
+        printUsage(originalArgv[0]);
         exit(EXIT_SUCCESS);
       } else if (strcmp(p + 1, "-version") == 0) {
-        // Print version information by actually invoking ldc -version.
-        const char *versionargs[] = {ldcPath.c_str(), "-version", nullptr};
-        execute(ldcPath, versionargs);
-        exit(EXIT_SUCCESS);
+        const char *versionargs[] = {ldcArgs[0], "-version", nullptr};
+        exit(ldcMain(2, const_cast<char **>(versionargs)));
       }
       /* -L
        * -defaultlib
        * -debuglib
        * -deps
+       * -lowmem
        * -main
        */
       else if (strncmp(p + 1, "man", 3) == 0) {
@@ -617,7 +613,7 @@ void translateArgs(size_t originalArgc, char **originalArgv,
       }
 #ifdef _WIN32
       else if (strcmp(p, "/?") == 0) {
-        printUsage(originalArgv[0], ldcPath);
+        printUsage(originalArgv[0]);
         exit(EXIT_SUCCESS);
       }
 #endif
@@ -630,7 +626,7 @@ void translateArgs(size_t originalArgc, char **originalArgv,
   if (noFiles && std::find_if(args.begin(), args.end(), [](const char *arg) {
                    return strncmp(arg, "-Xi=", 4) == 0;
                  }) == args.end()) {
-    printUsage(originalArgv[0], ldcPath);
+    printUsage(originalArgv[0]);
     if (originalArgc == 1)
       exit(EXIT_FAILURE); // compatible with DMD
     else
@@ -646,101 +642,19 @@ void translateArgs(size_t originalArgc, char **originalArgv,
   }
 }
 
-/**
- * Returns the OS-dependent length limit for the command line when invoking
- * subprocesses.
- */
-size_t maxCommandLineLen() {
-#if defined(HAVE_SC_ARG_MAX)
-  // http://www.in-ulm.de/~mascheck/various/argmax – the factor 2 is just
-  // a wild guess to account for the enviroment.
-  return sysconf(_SC_ARG_MAX) / 2;
-#elif defined(_WIN32)
-  // http://blogs.msdn.com/b/oldnewthing/archive/2003/12/10/56028.aspx
-  return 32767;
-#else
-#error "Do not know how to determine maximum command line length."
-#endif
-}
-
-/**
- * Tries to locate an executable with the given name, or an invalid path if
- * nothing was found. Search paths: 1. Directory where this binary resides.
- * 2. System PATH.
- */
-std::string locateBinary(std::string exeName) {
-  std::string path = exe_path::prependBinDir(exeName.c_str());
-  if (ls::fs::can_execute(path)) {
-    return path;
-  }
+} // anonymous namespace
 
-  llvm::ErrorOr<std::string> res = ls::findProgramByName(exeName);
-  path = res ? res.get() : std::string();
-  if (ls::fs::can_execute(path)) {
-    return path;
-  }
-
-  return "";
-}
-
-// In driver/main.d
-int main(int argc, char **argv);
-
-int cppmain(int argc, char **argv) {
+int ldmdMain(int argc, char **argv) {
   exe_path::initialize(argv[0]);
 
-  std::string ldcExeName = LDC_EXE_NAME;
-#ifdef _WIN32
-  ldcExeName += ".exe";
-#endif
-  const std::string ldcPath = locateBinary(ldcExeName);
-  if (ldcPath.empty()) {
-    error("Could not locate " LDC_EXE_NAME " executable.");
-  }
-
   // We need to manually set up argv[0] and the terminating NULL.
   std::vector<const char *> args;
-  args.push_back(ldcPath.c_str());
+  args.push_back(argv[0]);
 
   translateArgs(argc, argv, args);
 
   args.push_back(nullptr);
 
-  // Check if we can get away without a response file.
-  const size_t totalLen = std::accumulate(
-      args.begin(), args.end() - 1,
-      args.size() * 3, // quotes + space
-      [](size_t acc, const char *arg) { return acc + strlen(arg); });
-  if (totalLen <= maxCommandLineLen()) {
-    return execute(ldcPath, args.data());
-  }
-
-  int rspFd;
-  llvm::SmallString<128> rspPath;
-  if (ls::fs::createUniqueFile("ldmd-%%-%%-%%-%%.rsp", rspFd, rspPath)) {
-    error("Could not open temporary response file.");
-  }
-
-  {
-    llvm::raw_fd_ostream rspOut(rspFd, /*shouldClose=*/true);
-    // skip argv[0] and terminating NULL
-    for (auto it = args.begin() + 1, end = args.end() - 1; it != end; ++it) {
-      rspOut << *it << '\n';
-    }
-  }
-
-  std::string rspArg = "@";
-  rspArg += rspPath.str();
-
-  args.resize(1);
-  args.push_back(rspArg.c_str());
-  args.push_back(nullptr);
-
-  int rc = execute(ldcPath, args.data());
-
-  if (ls::fs::remove(rspPath.str())) {
-    warning("Could not remove response file.");
-  }
-
-  return rc;
+  return ldcMain(static_cast<int>(args.size() - 1),
+                 const_cast<char **>(args.data()));
 }
@@ -434,7 +434,7 @@ void ArgsBuilder::build(llvm::StringRef outputPath,
                         const std::vector<std::string> &defaultLibNames) {
   // object files
   for (auto objfile : global.params.objfiles) {
-    args.push_back(objfile);
+    args.push_back(getObjectFileForLinking(objfile));
   }
 
   // Link with profile-rt library when generating an instrumented binary.
@@ -694,6 +694,8 @@ int linkObjToBinaryGcc(llvm::StringRef outputPath,
       error(Loc(), "unknown target binary format for internal linking");
     }
 
+    releaseInMemoryObjectFiles();
+
     if (!success)
       error(Loc(), "linking with LLD failed");
 
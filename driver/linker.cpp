@@ -17,9 +17,22 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Linker/Linker.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
+#include <mutex>
 #include <sstream>
 
+// Object files can be handed to the integrated LLD as memfd files, opened via
+// /proc/self/fd/<N>.
+#if LDC_WITH_LLD && LDC_LLVM_VER >= 600 && defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef SYS_memfd_create
+#define LDC_IN_MEMORY_OBJECT_FILES 1
+#endif
+#endif
+
 namespace cl = llvm::cl;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -170,6 +183,54 @@ static std::vector<std::string> getDefaultLibNames() {
 
 bool useInternalLLDForLinking() { return linkInternally; }
 
+namespace {
+std::mutex inMemoryObjectFilesMutex;
+// Object file name => file descriptor of its in-memory file.
+llvm::StringMap<int> inMemoryObjectFiles;
+}
+
+bool useInMemoryObjectFiles() {
+#if LDC_IN_MEMORY_OBJECT_FILES
+  // Only if the object files are removed after linking anyway.
+  return linkInternally && global.params.link && !global.params.lib &&
+         (global.params.cleanupObjectFiles || global.params.run) &&
+         !global.params.targetTriple->isWindowsMSVCEnvironment();
+#else
+  return false;
+#endif
+}
+
+int createInMemoryObjectFile(llvm::StringRef objectFile) {
+#if LDC_IN_MEMORY_OBJECT_FILES
+  const std::string name = llvm::sys::path::filename(objectFile).str();
+  const int fd = static_cast<int>(syscall(SYS_memfd_create, name.c_str(), 0));
+  if (fd != -1) {
+    std::lock_guard<std::mutex> lock(inMemoryObjectFilesMutex);
+    inMemoryObjectFiles[objectFile] = fd;
+  }
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+std::string getObjectFileForLinking(llvm::StringRef objectFile) {
+  std::lock_guard<std::mutex> lock(inMemoryObjectFilesMutex);
+  const auto it = inMemoryObjectFiles.find(objectFile);
+  if (it == inMemoryObjectFiles.end())
+    return objectFile.str();
+  return ("/proc/self/fd/" + llvm::Twine(it->second)).str();
+}
+
+void releaseInMemoryObjectFiles() {
+#if LDC_IN_MEMORY_OBJECT_FILES
+  std::lock_guard<std::mutex> lock(inMemoryObjectFilesMutex);
+  for (const auto &entry : inMemoryObjectFiles)
+    close(entry.second);
+  inMemoryObjectFiles.clear();
+#endif
+}
+
 cl::boolOrDefault linkFullyStatic() { return staticFlag; }
 
 bool linkAgainstSharedDefaultLibs() {
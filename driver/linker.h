@@ -15,6 +15,7 @@
 #pragma once
 
 #include "llvm/Support/CommandLine.h" // for llvm::cl::boolOrDefault
+#include <string>
 
 namespace llvm {
 class Module;
@@ -28,6 +29,30 @@ template <typename TYPE> struct Array;
  */
 bool useInternalLLDForLinking();
 
+/**
+ * Indicates whether the object files are handed to the internal LLD as
+ * in-memory files instead of being written to disk. Only used when linking
+ * internally and the object files would be removed after linking anyway.
+ */
+bool useInMemoryObjectFiles();
+
+/**
+ * Creates an in-memory file for the object file, to be linked in its place.
+ * @return its file descriptor, or -1 on failure.
+ */
+int createInMemoryObjectFile(llvm::StringRef objectFile);
+
+/**
+ * Returns the path of the object file to be passed to the linker, i.e., of its
+ * in-memory file if there is one.
+ */
+std::string getObjectFileForLinking(llvm::StringRef objectFile);
+
+/**
+ * Closes the in-memory object files after linking.
+ */
+void releaseInMemoryObjectFiles();
+
 /**
  * Indicates the status of the -static command-line option.
  */
@@ -31,10 +31,14 @@
 #include "driver/exe_path.h"
 #include "driver/ldc-version.h"
 #include "driver/linker.h"
+#include "driver/memory_report.h"
 #include "driver/plugins.h"
+#include "driver/server.h"
 #include "driver/targetmachine.h"
+#include "driver/timetrace.h"
 #include "gen/abi.h"
 #include "gen/cl_helpers.h"
+#include "gen/function-report.h"
 #include "gen/irstate.h"
 #include "gen/ldctraits.h"
 #include "gen/linkage.h"
@@ -64,6 +68,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
 
 #if LDC_LLVM_VER >= 600
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
@@ -86,6 +91,9 @@ void gendocfile(Module *m);
 // In dmd/mars.d
 void generateJson(Modules *modules);
 
+// In driver/lexer_benchmark.d
+int runLexerBenchmark(Strings &files, unsigned iterations);
+
 using namespace opts;
 
 extern void getenv_setargv(const char *envvar, int *pargc, char ***pargv);
@@ -556,6 +564,14 @@ void parseCommandLine(int argc, char **argv, Strings &sourceFiles,
     error(Loc(), "-soname can be used only when building a shared library");
   }
 
+  // Make the cache directory absolute once, before the modules are (possibly
+  // concurrently) written.
+  if (!opts::cacheDir.empty()) {
+    llvm::SmallString<128> cacheDir(opts::cacheDir.c_str());
+    llvm::sys::fs::make_absolute(cacheDir);
+    opts::cacheDir = cacheDir.c_str();
+  }
+
   global.params.hdrStripPlainFunctions = !opts::hdrKeepAllBodies;
   global.params.disableRedZone = opts::disableRedZone();
 }
@@ -868,6 +884,23 @@ void registerPredefinedTargetVersions() {
   }
 }
 
+std::string getTimeTraceFileName() {
+  if (!opts::timeTraceFile.empty()) {
+    return opts::timeTraceFile;
+  }
+
+  const char *output = global.params.exefile;
+  if (!output && global.params.lib) {
+    output = global.params.libname;
+  }
+  if (!output && global.params.objfiles.dim) {
+    output = global.params.objfiles[0];
+  }
+  llvm::SmallString<128> fileName(output ? output : "ldc2");
+  llvm::sys::path::replace_extension(fileName, "time-trace");
+  return fileName.str();
+}
+
 } // anonymous namespace
 
 /// Registers all predefined D version identifiers for the current
@@ -944,6 +977,11 @@ void registerPredefinedVersions() {
 int cppmain(int argc, char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
 
+  int serverStatus;
+  if (server::forwardToServer(argc, argv, serverStatus)) {
+    return serverStatus;
+  }
+
   exe_path::initialize(argv[0]);
 
   global._init();
@@ -961,6 +999,10 @@ int cppmain(int argc, char **argv) {
 
   initializePasses();
 
+  // With -server=<socket>, the remaining command line is the configuration of
+  // the compile requests, served by the frontend (see serveRequests()).
+  server::initServerIfRequested(argc, argv);
+
   bool helpOnly;
   Strings files;
   parseCommandLine(argc, argv, files, helpOnly);
@@ -969,7 +1011,7 @@ int cppmain(int argc, char **argv) {
     return 0;
   }
 
-  if (files.dim == 0) {
+  if (files.dim == 0 && !server::isServer()) {
     if (global.params.jsonFieldFlags) {
       generateJson(nullptr);
       return EXIT_SUCCESS;
@@ -983,6 +1025,17 @@ int cppmain(int argc, char **argv) {
     fatal();
   }
 
+  if (opts::lexerBenchmark) {
+    return runLexerBenchmark(files, opts::lexerBenchmark);
+  }
+
+  if (opts::timeTrace) {
+    initializeTimeTrace(opts::timeTraceGranularity, "ldc2");
+  }
+  if (!opts::memoryReportFile.empty()) {
+    initializeMemoryReport();
+  }
+
   // Set up the TargetMachine.
   const auto arch = getArchStr();
   if ((m32bits || m64bits) && (!arch.empty() || !mTargetTriple.empty())) {
@@ -1057,7 +1110,25 @@ int cppmain(int argc, char **argv) {
   loadAllPlugins();
 
   Strings libmodules;
-  return mars_mainBody(files, libmodules);
+  const int status = mars_mainBody(files, libmodules);
+
+  if (opts::timeTrace) {
+    writeTimeTraceProfile(getTimeTraceFileName().c_str());
+  }
+  if (functionreport::enabled()) {
+    functionreport::writeReport();
+  }
+  if (!opts::memoryReportFile.empty()) {
+    writeMemoryReport(opts::memoryReportFile.c_str());
+  }
+
+  return status;
+}
+
+/// The number of threads for reading and parsing the root modules (-j).
+unsigned getNumParseThreads() {
+  const unsigned numThreads = opts::codegenThreads;
+  return numThreads ? numThreads : std::thread::hardware_concurrency();
 }
 
 void codegenModules(Modules &modules) {
@@ -1112,6 +1183,7 @@ void codegenModules(Modules &modules) {
       global.params.link = false;
   }
 
+  cache::writeStatistics();
   cache::pruneCache();
 
   freeRuntime();
@@ -0,0 +1,26 @@
+//===-- driver/memory_report.h ----------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The -memory-report implementation is in driver/memory_report.d.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "dmd/root/rmem.h"
+
+void initializeMemoryReport();
+
+void addLLVMModuleToMemoryReport(const char *name, d_size_t numGlobals,
+                                 d_size_t numFunctions,
+                                 d_size_t numBasicBlocks,
+                                 d_size_t numInstructions,
+                                 d_size_t freedMallocBytes);
+
+void writeMemoryReport(const char *filename);
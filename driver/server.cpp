@@ -0,0 +1,613 @@
+//===-- server.cpp --------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Protocol (over a Unix domain socket, one request per connection):
+// The client sends its stdin, stdout and stderr file descriptors (along with a
+// single dummy byte), followed by the 64-bit size of the request and the
+// request itself, a sequence of NUL-terminated strings:
+//   <working directory> <argc> <args>... <envc> <environment variables>...
+// The server replies with the 32-bit exit status of the compiler, or -1 if
+// the request doesn't match the server's configuration or the source file of
+// a preloaded module has changed since, in which case the client compiles
+// locally.
+//
+// The server parses its own command line and analyzes the preloaded modules
+// up-front (see serveRequests()). Every connection is then handled by a
+// forked supervisor process, which checks the request, forks the compiler
+// process off this state and reports its exit status. The server itself only
+// accepts connections.
+//
+// The socket is only accessible by the user running the server, and
+// connections of other users are rejected.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/server.h"
+
+#include "dmd/errors.h"
+#include "dmd/globals.h"
+#include "dmd/root/array.h"
+#include "driver/cl_options.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if LDC_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+// in driver/server_preload.d
+void preloadModule(const char *name);
+void getLoadedModuleFiles(Strings &files);
+
+// in driver/dircache.d
+void clearDirectoryCache();
+
+namespace {
+
+llvm::cl::list<std::string> preloadedModules(
+    "server-preload", llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::value_desc("modules"),
+    llvm::cl::desc("With -server, import and analyze these modules (e.g. "
+                   "std.stdio) in addition to object before serving the "
+                   "requests"));
+
+// The listening socket of the server, or -1.
+int listener = -1;
+// The server's command line after -server, without the -server-preload
+// options, and its working directory, which make up the configuration
+// requests have to match.
+std::vector<std::string> serverArgs;
+std::string serverWorkingDirectory;
+
+#if LDC_POSIX
+// The identity of a source file analyzed before serving the requests.
+struct PreloadedFile {
+  std::string path;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  timespec modificationTime;
+};
+std::vector<PreloadedFile> preloadedFiles;
+#endif
+
+// Returns the value of a `-<name>=<value>` or `--<name>=<value>` argument, or
+// null if it is a different argument.
+const char *getOptionValue(const char *arg, llvm::StringRef name) {
+  llvm::StringRef a(arg);
+  if (!a.startswith("-"))
+    return nullptr;
+  a = a.drop_front(a.startswith("--") ? 2 : 1);
+  if (!a.startswith(name) || !a.drop_front(name.size()).startswith("="))
+    return nullptr;
+  return arg + (strlen(arg) - a.size()) + name.size() + 1;
+}
+
+#if LDC_POSIX
+
+bool initAddress(sockaddr_un &address, llvm::StringRef path) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+  memcpy(address.sun_path, path.data(), path.size());
+  return true;
+}
+
+bool sendAll(int fd, const char *data, size_t size) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  while (size) {
+    const ssize_t n = send(fd, data, size, flags);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool receiveAll(int fd, char *data, size_t size) {
+  while (size) {
+    const ssize_t n = recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+const int numStdFds = 3;
+
+bool sendStdFds(int fd) {
+  int fds[numStdFds] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  char dummy = 0;
+  iovec iov = {&dummy, 1};
+  union {
+    cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(fds))];
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  ssize_t n;
+  do {
+    n = sendmsg(fd, &msg, 0);
+  } while (n < 0 && errno == EINTR);
+  return n == 1;
+}
+
+bool receiveStdFds(int fd, int (&fds)[numStdFds]) {
+  char dummy;
+  iovec iov = {&dummy, 1};
+  union {
+    cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(fds))];
+  } control;
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  ssize_t n;
+  do {
+    n = recvmsg(fd, &msg, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n != 1)
+    return false;
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    return false;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  return true;
+}
+
+struct Request {
+  std::string workingDirectory;
+  std::vector<std::string> args;
+  std::vector<std::string> environment;
+};
+
+void appendString(std::string &payload, llvm::StringRef str) {
+  payload.append(str.data(), str.size());
+  payload += '\0';
+}
+
+bool sendRequest(int fd, int argc, char **argv) {
+  llvm::SmallString<128> cwd;
+  if (llvm::sys::fs::current_path(cwd))
+    return false;
+
+  std::string payload;
+  appendString(payload, cwd);
+  appendString(payload, std::to_string(argc));
+  for (int i = 0; i < argc; ++i)
+    appendString(payload, argv[i]);
+  size_t envc = 0;
+  while (environ[envc])
+    ++envc;
+  appendString(payload, std::to_string(envc));
+  for (size_t i = 0; i < envc; ++i)
+    appendString(payload, environ[i]);
+
+  const uint64_t size = payload.size();
+  return sendStdFds(fd) &&
+         sendAll(fd, reinterpret_cast<const char *>(&size), sizeof(size)) &&
+         sendAll(fd, payload.data(), payload.size());
+}
+
+bool receiveRequest(int fd, Request &request) {
+  uint64_t size;
+  if (!receiveAll(fd, reinterpret_cast<char *>(&size), sizeof(size)))
+    return false;
+  std::string payload(size, '\0');
+  if (!receiveAll(fd, &payload[0], size))
+    return false;
+
+  std::vector<std::string> strings;
+  for (size_t start = 0; start < payload.size();) {
+    const size_t end = payload.find('\0', start);
+    if (end == std::string::npos)
+      return false;
+    strings.push_back(payload.substr(start, end - start));
+    start = end + 1;
+  }
+
+  size_t i = 0;
+  auto readList = [&](std::vector<std::string> &list) {
+    if (i >= strings.size())
+      return false;
+    const size_t n = strtoull(strings[i++].c_str(), nullptr, 10);
+    if (n > strings.size() - i)
+      return false;
+    list.assign(strings.begin() + i, strings.begin() + i + n);
+    i += n;
+    return true;
+  };
+
+  if (strings.empty())
+    return false;
+  request.workingDirectory = strings[i++];
+  return readList(request.args) && !request.args.empty() &&
+         readList(request.environment) && i == strings.size();
+}
+
+// Checks that the request's command line consists of the server's one,
+// followed by source files and -of/-od options (`extraArgs`), and that it's
+// in the server's working directory.
+bool matchesConfiguration(const Request &request,
+                          std::vector<std::string> &extraArgs) {
+  if (request.workingDirectory != serverWorkingDirectory ||
+      request.args.size() < serverArgs.size() + 1 ||
+      !std::equal(serverArgs.begin(), serverArgs.end(),
+                  request.args.begin() + 1))
+    return false;
+
+  extraArgs.assign(request.args.begin() + 1 + serverArgs.size(),
+                   request.args.end());
+  if (extraArgs.empty())
+    return false;
+  for (const auto &arg : extraArgs) {
+    const bool isSourceFile = !arg.empty() && arg[0] != '-' && arg[0] != '@';
+    if (!isSourceFile && !getOptionValue(arg.c_str(), "of") &&
+        !getOptionValue(arg.c_str(), "od"))
+      return false;
+  }
+  return true;
+}
+
+// Returns whether the peer of the connection is the user running the server.
+bool isSameUser(int connection) {
+#ifdef SO_PEERCRED
+  ucred credentials;
+  socklen_t size = sizeof(credentials);
+  return getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials,
+                    &size) == 0 &&
+         credentials.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  return getpeereid(connection, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+// Sets up the compiler process for the request and adds its source files and
+// output names.
+void applyRequest(const Request &request,
+                  const std::vector<std::string> &extraArgs,
+                  int (&fds)[numStdFds], Strings &files) {
+  // The received descriptors may occupy standard slots if the server's own
+  // standard streams are closed, so move them out of the way first.
+  for (int &fd : fds) {
+    const int moved = fcntl(fd, F_DUPFD, numStdFds);
+    close(fd);
+    fd = moved;
+  }
+  for (int i = 0; i < numStdFds; ++i) {
+    dup2(fds[i], i);
+    close(fds[i]);
+  }
+
+  for (const auto &arg : extraArgs) {
+    const char *copy = strdup(arg.c_str());
+    // The cache key depends on all arguments.
+    opts::allArguments.push_back(copy);
+    if (const char *objectFile = getOptionValue(copy, "of")) {
+      global.params.objname = objectFile;
+    } else if (const char *objectDir = getOptionValue(copy, "od")) {
+      global.params.objdir = objectDir;
+    } else {
+      files.push(copy);
+    }
+  }
+
+  static std::vector<std::string> environment;
+  static std::vector<char *> environmentPtrs;
+  environment = request.environment;
+  for (auto &var : environment)
+    environmentPtrs.push_back(&var[0]);
+  environmentPtrs.push_back(nullptr);
+  environ = environmentPtrs.data();
+
+  if (chdir(request.workingDirectory.c_str())) {
+    error(Loc(), "Cannot change to working directory %s: %s",
+          request.workingDirectory.c_str(), strerror(errno));
+    fatal();
+  }
+
+  // The directories listed by the server may have changed since.
+  clearDirectoryCache();
+}
+
+bool getPreloadedFile(const char *path, PreloadedFile &file) {
+  struct stat info;
+  if (stat(path, &info))
+    return false;
+  file.path = path;
+  file.device = info.st_dev;
+  file.inode = info.st_ino;
+  file.size = info.st_size;
+#ifdef __APPLE__
+  file.modificationTime = info.st_mtimespec;
+#else
+  file.modificationTime = info.st_mtim;
+#endif
+  return true;
+}
+
+// Records the identity of the source files of the preloaded modules and their
+// imports.
+void recordPreloadedFiles() {
+  Strings paths;
+  getLoadedModuleFiles(paths);
+  for (const char *path : paths) {
+    PreloadedFile file;
+    if (getPreloadedFile(path, file))
+      preloadedFiles.push_back(file);
+  }
+}
+
+// Returns whether the source files analyzed up-front are still the same, i.e.,
+// whether the requests may be compiled off the preloaded state.
+bool arePreloadedFilesUnchanged() {
+  for (const auto &file : preloadedFiles) {
+    PreloadedFile current;
+    if (!getPreloadedFile(file.path.c_str(), current) ||
+        current.device != file.device || current.inode != file.inode ||
+        current.size != file.size ||
+        current.modificationTime.tv_sec != file.modificationTime.tv_sec ||
+        current.modificationTime.tv_nsec != file.modificationTime.tv_nsec)
+      return false;
+  }
+  return true;
+}
+
+// Runs in the supervisor process forked for a connection. Only returns in the
+// compiler process.
+void handleConnection(int connection, Strings &files) {
+  int fds[numStdFds];
+  Request request;
+  if (!receiveStdFds(connection, fds))
+    _exit(EXIT_FAILURE);
+  if (!receiveRequest(connection, request))
+    _exit(EXIT_FAILURE);
+
+  // Once a preloaded module has changed (e.g. an updated druntime), the
+  // server's state is stale and all requests are compiled locally.
+  std::vector<std::string> extraArgs;
+  if (!matchesConfiguration(request, extraArgs) ||
+      !arePreloadedFilesUnchanged()) {
+    const int32_t compileLocally = -1;
+    sendAll(connection, reinterpret_cast<const char *>(&compileLocally),
+            sizeof(compileLocally));
+    _exit(EXIT_SUCCESS);
+  }
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(connection);
+    applyRequest(request, extraArgs, fds, files);
+    return;
+  }
+
+  for (int fd : fds)
+    close(fd);
+
+  int32_t exitStatus = EXIT_FAILURE;
+  int status;
+  pid_t result = -1;
+  if (pid > 0) {
+    do {
+      result = waitpid(pid, &status, 0);
+    } while (result == -1 && errno == EINTR);
+  }
+  if (result == pid) {
+    if (WIFEXITED(status))
+      exitStatus = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+      exitStatus = 128 + WTERMSIG(status);
+  }
+
+  sendAll(connection, reinterpret_cast<const char *>(&exitStatus),
+          sizeof(exitStatus));
+  _exit(EXIT_SUCCESS);
+}
+
+#endif // LDC_POSIX
+
+} // anonymous namespace
+
+namespace server {
+
+bool forwardToServer(int &argc, char **&argv, int &status) {
+  const char *socketPath =
+      argc >= 2 ? getOptionValue(argv[1], "use-server") : nullptr;
+  if (!socketPath)
+    return false;
+
+  // Remove the -use-server argument.
+  argv[1] = argv[0];
+  ++argv;
+  --argc;
+
+#if LDC_POSIX
+  sockaddr_un address;
+  if (!initAddress(address, socketPath))
+    return false;
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return false;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) ||
+      !sendRequest(fd, argc, argv)) {
+    close(fd);
+    return false; // compile locally
+  }
+
+  int32_t exitStatus;
+  if (!receiveAll(fd, reinterpret_cast<char *>(&exitStatus),
+                  sizeof(exitStatus))) {
+    // The request may have been processed partially, so don't fall back to
+    // compiling locally.
+    fprintf(stderr, "Error: Lost connection to compiler server %s\n",
+            socketPath);
+    exitStatus = EXIT_FAILURE;
+  }
+  close(fd);
+  if (exitStatus == -1)
+    return false; // not matching the server's configuration
+
+  status = exitStatus;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool initServerIfRequested(int &argc, char **&argv) {
+  const char *socketPath =
+      argc >= 2 ? getOptionValue(argv[1], "server") : nullptr;
+  if (!socketPath)
+    return false;
+
+  // Remove the -server argument.
+  argv[1] = argv[0];
+  ++argv;
+  --argc;
+
+#if LDC_POSIX
+  for (int i = 1; i < argc; ++i) {
+    if (!getOptionValue(argv[i], "server-preload"))
+      serverArgs.push_back(argv[i]);
+  }
+  llvm::SmallString<128> cwd;
+  if (llvm::sys::fs::current_path(cwd)) {
+    error(Loc(), "Cannot determine the working directory");
+    fatal();
+  }
+  serverWorkingDirectory = cwd.str();
+
+  sockaddr_un address;
+  if (!initAddress(address, socketPath)) {
+    error(Loc(), "Server socket path is too long: %s", socketPath);
+    fatal();
+  }
+
+  unlink(socketPath); // stale socket of a previous server
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  // Only the user running the server may connect.
+  const mode_t oldMask = umask(077);
+  const bool bound =
+      listener != -1 &&
+      bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) == 0;
+  umask(oldMask);
+  if (!bound || chmod(socketPath, 0600) || listen(listener, 128)) {
+    error(Loc(), "Cannot listen on %s: %s", socketPath, strerror(errno));
+    fatal();
+  }
+  return true;
+#else
+  error(Loc(), "-server is only supported on POSIX systems");
+  fatal();
+  return false;
+#endif
+}
+
+bool isServer() { return listener != -1; }
+}
+
+bool serveRequests(Strings &files) {
+  if (!server::isServer())
+    return false;
+
+#if LDC_POSIX
+  preloadModule("object");
+  for (const auto &name : preloadedModules)
+    preloadModule(name.c_str());
+  recordPreloadedFiles();
+
+  while (true) {
+    const int connection = accept(listener, nullptr, nullptr);
+    if (connection == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM) {
+        // Out of resources; give the supervisor processes a chance to finish.
+        while (waitpid(-1, nullptr, WNOHANG) > 0) {
+        }
+        usleep(100 * 1000);
+        continue;
+      }
+      error(Loc(), "Cannot accept connections: %s", strerror(errno));
+      fatal();
+    }
+    if (!isSameUser(connection)) {
+      close(connection);
+      continue;
+    }
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(listener);
+      listener = -1;
+      handleConnection(connection, files);
+      return true;
+    }
+    close(connection);
+
+    // Reap the finished supervisor processes.
+    while (waitpid(-1, nullptr, WNOHANG) > 0) {
+    }
+  }
+#endif
+  return false;
+}
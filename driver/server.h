@@ -0,0 +1,51 @@
+//===-- driver/server.h - Compiler server -----------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// `ldc2 -server=<socket> <args>...` keeps a process alive with LLVM
+// initialized, the command line parsed and the object module as well as the
+// -server-preload modules analyzed. It compiles the command lines of
+// `ldc2 -use-server=<socket> <args>... <source files and -of/-od>...`
+// invocations from the same working directory. Each request is compiled in a
+// process forked off the server, in the client's environment and writing to
+// the client's standard streams, so that the output is identical to a
+// regular invocation. Other requests are compiled locally by the client.
+//
+// Only POSIX systems are supported.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+template <typename TYPE> struct Array;
+typedef Array<const char *> Strings;
+
+namespace server {
+
+/// If the first argument is -use-server=<socket>, sends the remaining command
+/// line to the server and returns true, with the compiler's exit status.
+/// If the server cannot be reached or the command line doesn't match the
+/// server's one, the argument is removed from the command line and false is
+/// returned, i.e., the caller compiles locally.
+bool forwardToServer(int &argc, char **&argv, int &status);
+
+/// If the first argument is -server=<socket>, removes it from the command
+/// line and starts listening on the socket. The remaining command line is
+/// the one shared by all requests.
+bool initServerIfRequested(int &argc, char **&argv);
+
+/// Returns whether this process is the server, i.e., hasn't been forked off
+/// for a request yet.
+bool isServer();
+}
+
+/// Called by the frontend once initialized with the server's command line:
+/// Analyzes the preloaded modules and serves the requests. Only returns (true)
+/// in the processes forked off for the requests, with their source files and
+/// output names. Returns false if not running as server.
+bool serveRequests(Strings &files);
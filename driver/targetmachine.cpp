@@ -101,7 +101,7 @@ static const char *getABI(const llvm::Triple &triple) {
   }
 }
 
-extern llvm::TargetMachine *gTargetMachine;
+extern thread_local llvm::TargetMachine *gTargetMachine;
 
 MipsABI::Type getMipsABI() {
   // eabi can only be set on the commandline
@@ -503,6 +503,13 @@ createTargetMachine(const std::string targetTriple, const std::string arch,
                                      codeGenOptLevel);
 }
 
+llvm::TargetMachine *cloneTargetMachine(const llvm::TargetMachine &tm) {
+  return tm.getTarget().createTargetMachine(
+      tm.getTargetTriple().str(), tm.getTargetCPU(),
+      tm.getTargetFeatureString(), tm.Options, tm.getRelocationModel(),
+      tm.getCodeModel(), tm.getOptLevel());
+}
+
 ComputeBackend::Type getComputeTargetType(llvm::Module* m) {
   llvm::Triple::ArchType a = llvm::Triple(m->getTargetTriple()).getArch();
   if (a == llvm::Triple::spir || a == llvm::Triple::spir64)
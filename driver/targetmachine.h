@@ -64,6 +64,13 @@ createTargetMachine(std::string targetTriple, std::string arch, std::string cpu,
                     llvm::CodeGenOpt::Level codeGenOptLevel,
                     bool noLinkerStripDead);
 
+/**
+ * Creates a new TargetMachine with the same target, CPU, features and options
+ * as the given one. TargetMachines must not be shared across threads, so this
+ * is used to set up the backend worker threads.
+ */
+llvm::TargetMachine *cloneTargetMachine(const llvm::TargetMachine &tm);
+
 /**
  * Returns the Mips ABI which is used for code generation.
  *
@@ -0,0 +1,340 @@
+//===-- timetrace.cpp -----------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The recorded spans are kept per thread and only merged when writing the
+// profile, so that recording doesn't need any synchronization.
+//
+// The legacy pass managers don't offer any instrumentation hooks, so the spans
+// of the LLVM passes are recorded by marker passes of the same kind, run
+// before and after the profiled pass. They also collect the per-function pass
+// times for -function-report.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/timetrace.h"
+
+#include "dmd/errors.h"
+#include "driver/json.h"
+#include "gen/function-report.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+bool _timeTraceEnabled = false;
+
+namespace {
+
+struct Span {
+  std::string name;
+  std::string detail;
+  Clock::time_point start;
+  Clock::duration duration;
+};
+
+struct Total {
+  size_t count = 0;
+  Clock::duration duration = Clock::duration::zero();
+};
+
+struct ThreadProfiler {
+  unsigned tid;
+  std::vector<Span> stack;   // begun, not yet ended
+  std::vector<Span> entries; // ended, at least as long as the granularity
+  llvm::StringMap<Total> totals;
+
+  explicit ThreadProfiler(unsigned tid) : tid(tid) {}
+
+  void finish(Span &&span) {
+    span.duration = Clock::now() - span.start;
+
+    // Don't count recursive spans twice.
+    const bool isOutermost =
+        std::none_of(stack.begin(), stack.end(),
+                     [&](const Span &s) { return s.name == span.name; });
+    if (isOutermost) {
+      Total &total = totals[span.name];
+      ++total.count;
+      total.duration += span.duration;
+    }
+
+    if (span.duration >= granularity)
+      entries.push_back(std::move(span));
+  }
+
+  static Clock::duration granularity;
+};
+
+Clock::duration ThreadProfiler::granularity;
+
+Clock::time_point startTime;
+std::string processName;
+
+std::mutex profilersMutex;
+std::vector<std::unique_ptr<ThreadProfiler>> profilers;
+
+thread_local ThreadProfiler *threadProfiler = nullptr;
+
+ThreadProfiler &getThreadProfiler() {
+  if (!threadProfiler) {
+    std::lock_guard<std::mutex> lock(profilersMutex);
+    const unsigned tid = profilers.size() + 1;
+    profilers.emplace_back(new ThreadProfiler(tid));
+    threadProfiler = profilers.back().get();
+  }
+  return *threadProfiler;
+}
+
+long long toMicroseconds(Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+void writeEvent(llvm::raw_ostream &os, bool &first, unsigned tid,
+                llvm::StringRef name, long long ts, long long dur,
+                llvm::StringRef args) {
+  os << (first ? "\n" : ",\n") << R"({"pid":1,"tid":)" << tid
+     << R"(,"ph":"X","ts":)" << ts << R"(,"dur":)" << dur << R"(,"name":)";
+  writeJSONString(os, name);
+  if (!args.empty())
+    os << R"(,"args":{)" << args << '}';
+  os << '}';
+  first = false;
+}
+
+// The state shared by a pair of marker passes.
+struct PassSpan {
+  std::string name;
+  std::string detail; // the function name for per-function passes
+  bool isPerFunction = false;
+  Clock::time_point start;
+  bool started = false;
+
+  void begin(llvm::StringRef d) {
+    detail = d;
+    start = Clock::now();
+    started = true;
+  }
+
+  // Not reached if the pass has deleted the loop, in which case the next
+  // begin() discards the span.
+  void end() {
+    if (!started)
+      return;
+    started = false;
+    if (timeTraceProfilerEnabled())
+      timeTraceProfilerAddSpan(name.c_str(), detail.c_str(), start);
+    if (isPerFunction && functionreport::enabled())
+      functionreport::addOptimizationTime(detail, Clock::now() - start);
+  }
+};
+
+// The begin marker requires the analyses required by the profiled pass, so
+// that it doesn't end up in a separate (loop) pass manager.
+std::vector<llvm::AnalysisID> getRequiredAnalyses(const llvm::Pass *pass) {
+  llvm::AnalysisUsage usage;
+  pass->getAnalysisUsage(usage);
+  const auto &required = usage.getRequiredSet();
+  return {required.begin(), required.end()};
+}
+
+#define DEFINE_MARKER_PASS(ClassName, BaseClass, RunMethod, Params, Detail)   \
+  class ClassName : public llvm::BaseClass {                                  \
+    std::shared_ptr<PassSpan> span;                                           \
+    std::vector<llvm::AnalysisID> requiredAnalyses;                           \
+    bool isBegin;                                                             \
+                                                                              \
+  public:                                                                     \
+    static char ID;                                                           \
+    ClassName(const llvm::Pass *pass, std::shared_ptr<PassSpan> span,         \
+              bool isBegin)                                                   \
+        : llvm::BaseClass(ID), span(std::move(span)), isBegin(isBegin) {      \
+      if (isBegin)                                                            \
+        requiredAnalyses = getRequiredAnalyses(pass);                         \
+    }                                                                         \
+                                                                              \
+    void getAnalysisUsage(llvm::AnalysisUsage &au) const override {           \
+      llvm::BaseClass::getAnalysisUsage(au);                                  \
+      for (auto id : requiredAnalyses)                                        \
+        au.addRequiredID(id);                                                 \
+      au.setPreservesAll();                                                   \
+    }                                                                         \
+                                                                              \
+    bool RunMethod Params override {                                          \
+      if (isBegin)                                                            \
+        span->begin(Detail);                                                  \
+      else                                                                    \
+        span->end();                                                          \
+      return false;                                                           \
+    }                                                                         \
+  };                                                                          \
+  char ClassName::ID = 0;
+
+llvm::StringRef getSCCName(llvm::CallGraphSCC &scc) {
+  for (llvm::CallGraphNode *node : scc) {
+    if (const llvm::Function *f = node->getFunction())
+      return f->getName();
+  }
+  return "";
+}
+
+DEFINE_MARKER_PASS(ModuleMarkerPass, ModulePass, runOnModule,
+                   (llvm::Module & m), m.getModuleIdentifier())
+DEFINE_MARKER_PASS(CallGraphSCCMarkerPass, CallGraphSCCPass, runOnSCC,
+                   (llvm::CallGraphSCC & scc), getSCCName(scc))
+DEFINE_MARKER_PASS(FunctionMarkerPass, FunctionPass, runOnFunction,
+                   (llvm::Function & f), f.getName())
+DEFINE_MARKER_PASS(LoopMarkerPass, LoopPass, runOnLoop,
+                   (llvm::Loop * l, llvm::LPPassManager &),
+                   l->getHeader()->getParent()->getName())
+
+#undef DEFINE_MARKER_PASS
+
+template <class MarkerPass>
+std::pair<llvm::Pass *, llvm::Pass *>
+createMarkerPasses(const llvm::Pass *pass, bool isPerFunction = false) {
+  auto span = std::make_shared<PassSpan>();
+  span->name = llvm::StringRef(pass->getPassName()).str();
+  span->isPerFunction = isPerFunction;
+  return {new MarkerPass(pass, span, true), new MarkerPass(pass, span, false)};
+}
+
+} // anonymous namespace
+
+void initializeTimeTrace(unsigned granularityInMicroseconds,
+                         const char *processName) {
+  ThreadProfiler::granularity =
+      std::chrono::microseconds(granularityInMicroseconds);
+  ::processName = processName;
+  startTime = Clock::now();
+  _timeTraceEnabled = true;
+}
+
+void timeTraceProfilerBegin(const char *name, const char *detail) {
+  getThreadProfiler().stack.push_back(
+      {name, detail ? detail : "", Clock::now(), Clock::duration::zero()});
+}
+
+void timeTraceProfilerEnd() {
+  ThreadProfiler &profiler = getThreadProfiler();
+  assert(!profiler.stack.empty() && "unbalanced time trace spans");
+  Span span = std::move(profiler.stack.back());
+  profiler.stack.pop_back();
+  profiler.finish(std::move(span));
+}
+
+void timeTraceProfilerAddSpan(const char *name, const char *detail,
+                              Clock::time_point start) {
+  getThreadProfiler().finish(
+      {name, detail ? detail : "", start, Clock::duration::zero()});
+}
+
+void writeTimeTraceProfile(const char *filename) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(filename, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    error(Loc(), "Cannot open time trace file %s: %s", filename,
+          ec.message().c_str());
+    fatal();
+  }
+
+  os << R"({"traceEvents":[)";
+  bool first = true;
+
+  llvm::StringMap<Total> totals;
+  std::string args;
+  for (const auto &profiler : profilers) {
+    for (const Span &span : profiler->entries) {
+      args.clear();
+      if (!span.detail.empty()) {
+        llvm::raw_string_ostream argsOS(args);
+        argsOS << R"("detail":)";
+        writeJSONString(argsOS, span.detail);
+        argsOS.flush();
+      }
+      writeEvent(os, first, profiler->tid, span.name,
+                 toMicroseconds(span.start - startTime),
+                 toMicroseconds(span.duration), args);
+    }
+
+    for (const auto &entry : profiler->totals) {
+      Total &total = totals[entry.getKey()];
+      total.count += entry.getValue().count;
+      total.duration += entry.getValue().duration;
+    }
+  }
+
+  // Write the totals on separate tracks, the longest first.
+  std::vector<const llvm::StringMapEntry<Total> *> sortedTotals;
+  for (const auto &entry : totals)
+    sortedTotals.push_back(&entry);
+  std::sort(sortedTotals.begin(), sortedTotals.end(),
+            [](const llvm::StringMapEntry<Total> *a,
+               const llvm::StringMapEntry<Total> *b) {
+              return a->getValue().duration > b->getValue().duration;
+            });
+  unsigned tid = profilers.size();
+  for (const auto *entry : sortedTotals) {
+    const Total &total = entry->getValue();
+    const double ms =
+        std::chrono::duration<double, std::milli>(total.duration).count();
+    args.clear();
+    llvm::raw_string_ostream argsOS(args);
+    argsOS << R"("count":)" << total.count << R"(,"avg ms":)"
+           << llvm::format("%.3f", ms / total.count);
+    argsOS.flush();
+    writeEvent(os, first, ++tid, ("Total " + entry->getKey()).str(), 0,
+               toMicroseconds(total.duration), args);
+  }
+
+  os << (first ? "\n" : ",\n")
+     << R"({"pid":1,"tid":0,"ph":"M","name":"process_name","args":{"name":)";
+  writeJSONString(os, processName);
+  os << "}}\n],\n" << R"("beginningOfTime":0,"displayTimeUnit":"ms"})" << '\n';
+
+  os.close();
+  if (os.has_error()) {
+    error(Loc(), "Cannot write time trace file %s", filename);
+    os.clear_error();
+    fatal();
+  }
+}
+
+std::pair<llvm::Pass *, llvm::Pass *> createPassTimingMarkers(llvm::Pass *pass) {
+  if ((!timeTraceProfilerEnabled() && !functionreport::enabled()) ||
+      pass->getAsImmutablePass())
+    return {nullptr, nullptr};
+
+  switch (pass->getPassKind()) {
+  case llvm::PT_Module:
+    return createMarkerPasses<ModuleMarkerPass>(pass);
+  case llvm::PT_CallGraphSCC:
+    return createMarkerPasses<CallGraphSCCMarkerPass>(pass);
+  case llvm::PT_Function:
+    return createMarkerPasses<FunctionMarkerPass>(pass, true);
+  case llvm::PT_Loop:
+    return createMarkerPasses<LoopMarkerPass>(pass, true);
+  default:
+    return {nullptr, nullptr};
+  }
+}
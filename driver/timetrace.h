@@ -0,0 +1,79 @@
+//===-- driver/timetrace.h - Chrome trace time profiler ---------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The -ftime-trace profiler records nested, named time spans per thread and
+// writes them as a Chrome trace JSON file (chrome://tracing, Speedscope etc.).
+// Spans shorter than the granularity are discarded, but still contribute to
+// the per-name totals, which are written as separate tracks.
+//
+// driver/timetrace.d provides the frontend's interface.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>
+#include <utility>
+
+namespace llvm {
+class Pass;
+}
+
+extern bool _timeTraceEnabled;
+
+/// Enables the profiler. Must be called before spawning any threads.
+void initializeTimeTrace(unsigned granularityInMicroseconds,
+                         const char *processName);
+
+inline bool timeTraceProfilerEnabled() { return _timeTraceEnabled; }
+
+/// Begins a span on the current thread. The strings are copied.
+void timeTraceProfilerBegin(const char *name, const char *detail);
+
+/// Ends the innermost span of the current thread.
+void timeTraceProfilerEnd();
+
+/// Records a span of the current thread from `start` until now, not
+/// necessarily nested within the spans begun by timeTraceProfilerBegin().
+void timeTraceProfilerAddSpan(const char *name, const char *detail,
+                              std::chrono::steady_clock::time_point start);
+
+/// Returns the time elapsed since `start` in milliseconds.
+inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/// Writes the spans of all threads, which must not be running anymore.
+void writeTimeTraceProfile(const char *filename);
+
+/// Returns the marker passes to be added before and after `pass` to time each
+/// run of it for -ftime-trace and -function-report, or null if the pass is not
+/// timed.
+std::pair<llvm::Pass *, llvm::Pass *> createPassTimingMarkers(llvm::Pass *pass);
+
+class TimeTraceScope {
+  bool active;
+
+public:
+  explicit TimeTraceScope(const char *name, const char *detail = nullptr)
+      : active(timeTraceProfilerEnabled()) {
+    if (active)
+      timeTraceProfilerBegin(name, detail);
+  }
+
+  ~TimeTraceScope() {
+    if (active)
+      timeTraceProfilerEnd();
+  }
+
+  TimeTraceScope(const TimeTraceScope &) = delete;
+  TimeTraceScope &operator=(const TimeTraceScope &) = delete;
+};
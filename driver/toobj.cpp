@@ -9,13 +9,21 @@
 
 #include "driver/toobj.h"
 
+#include "dmd/errors.h"
+#include "driver/archiver.h"
+#include "driver/backendpool.h"
 #include "driver/cl_options.h"
 #include "driver/cache.h"
+#include "driver/linker.h"
 #include "driver/targetmachine.h"
+#include "driver/timetrace.h"
 #include "driver/tool.h"
+#include "gen/function-report.h"
 #include "gen/irstate.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Analysis/ModuleSummaryAnalysis.h"
@@ -29,6 +37,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/Path.h"
 #ifdef LDC_LLVM_SUPPORTED_TARGET_SPIRV
@@ -42,23 +52,42 @@
 #include "llvm/Target/TargetSubtargetInfo.h"
 #endif
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 #include "llvm/IR/Module.h"
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 static llvm::cl::opt<bool>
     NoIntegratedAssembler("no-integrated-as", llvm::cl::ZeroOrMore,
                           llvm::cl::Hidden,
                           llvm::cl::desc("Disable integrated assembler"));
 
+static llvm::cl::opt<unsigned> cacheFragments(
+    "cache-fragments", llvm::cl::ZeroOrMore, llvm::cl::value_desc("N"),
+    llvm::cl::init(0),
+    llvm::cl::desc("Split modules into <N> fragments after optimization, "
+                   "caching their object code separately (requires -cache, "
+                   "and gcc or -gcc for merging the object files, not "
+                   "supported for MSVC targets)"));
+
 namespace {
 
 // based on llc code, University of Illinois Open Source License
 void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
-                   llvm::raw_fd_ostream &out,
+                   llvm::raw_pwrite_stream &out,
                    llvm::TargetMachine::CodeGenFileType fileType) {
   using namespace llvm;
 
+  TimeTraceScope timeScope(fileType == TargetMachine::CGFT_AssemblyFile
+                               ? "Machine codegen (assembly)"
+                               : "Machine codegen",
+                           m.getModuleIdentifier().c_str());
+
 // Create a PassManager to hold and optimize the collection of passes we are
 // about to build.
   legacy::PassManager Passes;
@@ -85,9 +114,17 @@ void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
   Passes.add(
       createTargetTransformInfoWrapperPass(Target.getTargetIRAnalysis()));
 
+  // For -function-report, generate the object file into a buffer first to
+  // collect the machine code sizes of the functions.
+  const bool reportCodeSizes = functionreport::enabled() &&
+                               cb == ComputeBackend::None &&
+                               fileType == TargetMachine::CGFT_ObjectFile;
+  SmallVector<char, 0> objectBuffer;
+  raw_svector_ostream objectBufferOS(objectBuffer);
+
   if (Target.addPassesToEmitFile(
           Passes,
-          out, // Output file
+          reportCodeSizes ? objectBufferOS : out, // Output file
 #if LDC_LLVM_VER >= 700
           nullptr, // DWO output file
 #endif
@@ -100,6 +137,14 @@ void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
   }
 
   Passes.run(m);
+
+  if (reportCodeSizes) {
+    const StringRef object(objectBuffer.data(), objectBuffer.size());
+    functionreport::addMachineCodeSizes(
+        MemoryBufferRef(object, m.getModuleIdentifier()),
+        m.getDataLayout().getGlobalPrefix());
+    out << object;
+  }
 }
 
 void cloneAndCodegenModule(llvm::TargetMachine &Target, llvm::Module &m,
@@ -280,6 +325,447 @@ void writeObjectFile(llvm::Module *m, const char *filename) {
   }
 }
 
+/// Generates the object file into an in-memory file, which is handed to the
+/// internal LLD directly (see useInMemoryObjectFiles()). Falls back to writing
+/// it to disk if no in-memory file can be created.
+void writeObjectFileInMemory(llvm::Module *m, const char *filename) {
+  const int fd = createInMemoryObjectFile(filename);
+  if (fd == -1) {
+    writeObjectFile(m, filename);
+    return;
+  }
+
+  IF_LOG Logger::println("Writing object file to memory for: %s", filename);
+  llvm::raw_fd_ostream out(fd, /*shouldClose=*/false);
+  codegenModule(*gTargetMachine, *m, out, llvm::TargetMachine::CGFT_ObjectFile);
+}
+
+/// Generates the object file into memory, to be archived directly by
+/// createStaticLibrary() (see useInMemoryArchiveMembers()).
+void writeArchiveMemberInMemory(llvm::Module *m, const char *filename) {
+  IF_LOG Logger::println("Writing object file to memory for: %s", filename);
+  llvm::SmallVector<char, 0> buffer;
+  {
+    llvm::raw_svector_ostream out(buffer);
+    codegenModule(*gTargetMachine, *m, out,
+                  llvm::TargetMachine::CGFT_ObjectFile);
+  }
+  addInMemoryArchiveMember(
+      filename, llvm::MemoryBuffer::getMemBufferCopy(
+                    llvm::StringRef(buffer.data(), buffer.size()),
+                    llvm::sys::path::filename(filename)));
+}
+
+/// Returns whether object files can be merged by mergeObjectFiles(), i.e.,
+/// whether there is a C compiler for the relocatable link. Otherwise, modules
+/// are written as a whole instead of as fragments or partitions.
+bool canMergeObjectFiles() {
+  // A relocatable link isn't supported by the MSVC toolchain.
+  if (global.params.targetTriple->isWindowsMSVCEnvironment())
+    return false;
+
+  static const bool haveLinker = [] {
+    const bool found = !findGcc().empty();
+    if (!found)
+      IF_LOG Logger::println(
+          "No C compiler found for merging object files, writing modules "
+          "as a whole");
+    return found;
+  }();
+  return haveLinker;
+}
+
+// Merges the object files into `filename` by a relocatable link.
+void mergeObjectFiles(const std::vector<std::string> &objpaths,
+                      const char *filename) {
+  std::vector<std::string> args;
+  args.push_back("-r");
+  args.push_back("-nostdlib");
+  args.push_back("-o");
+  args.push_back(filename);
+  args.insert(args.end(), objpaths.begin(), objpaths.end());
+
+  appendTargetArgsForGcc(args);
+
+  int R = executeToolAndWait(getGcc(), args, global.params.verbose);
+  if (R) {
+    error(Loc(), "Error while merging the object file fragments of '%s'.",
+          filename);
+    fatal();
+  }
+}
+
+/// Calls `f` for all global values using `v`, directly or via constants.
+template <typename F> void forEachGlobalUser(const llvm::Value *v, F f) {
+  llvm::SmallVector<const llvm::User *, 8> worklist(v->user_begin(),
+                                                    v->user_end());
+  llvm::SmallPtrSet<const llvm::User *, 8> visited;
+  while (!worklist.empty()) {
+    const llvm::User *u = worklist.pop_back_val();
+    if (!visited.insert(u).second)
+      continue;
+    if (auto inst = llvm::dyn_cast<llvm::Instruction>(u)) {
+      f(inst->getParent()->getParent());
+    } else if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(u)) {
+      f(gv);
+    } else {
+      worklist.append(u->user_begin(), u->user_end());
+    }
+  }
+}
+
+/// Splits the module into `numFragments` modules like llvm::SplitModule()
+/// with PreserveLocals=true, i.e., local symbols are kept in the same fragment
+/// as their users, as are the members of a comdat and aliases and their
+/// aliasees. But instead of balancing the sizes of the fragments, each such
+/// group is assigned by the hash of the smallest name of its non-local
+/// members, so that adding or changing a function leaves the other
+/// fragments alone.
+void splitModuleByNameHash(
+    const llvm::Module &m, unsigned numFragments,
+    llvm::function_ref<void(std::unique_ptr<llvm::Module>)> callback) {
+  using namespace llvm;
+
+  EquivalenceClasses<const GlobalValue *> groups;
+  DenseMap<const Comdat *, const GlobalValue *> comdatMembers;
+  for (const GlobalValue &gv : m.global_values()) {
+    if (gv.isDeclaration())
+      continue;
+    groups.insert(&gv);
+    if (const Comdat *c = gv.getComdat()) {
+      const GlobalValue *&member = comdatMembers[c];
+      if (member)
+        groups.unionSets(member, &gv);
+      else
+        member = &gv;
+    }
+    if (const GlobalObject *base = gv.getBaseObject())
+      if (base != &gv && !base->isDeclaration())
+        groups.unionSets(&gv, base);
+    if (gv.hasLocalLinkage()) {
+      forEachGlobalUser(&gv, [&](const GlobalValue *user) {
+        if (!user->isDeclaration())
+          groups.unionSets(&gv, user);
+      });
+    }
+  }
+
+  // The names of local symbols, e.g. of string literals, are numbered
+  // module-wide and thus not stable.
+  DenseMap<const GlobalValue *, unsigned> fragmentOf;
+  for (auto it = groups.begin(), end = groups.end(); it != end; ++it) {
+    if (!it->isLeader())
+      continue;
+    StringRef key;
+    bool keyIsLocal = true;
+    for (auto member = groups.member_begin(it); member != groups.member_end();
+         ++member) {
+      const GlobalValue *gv = *member;
+      const bool isLocal = gv->hasLocalLinkage();
+      if ((keyIsLocal && !isLocal) ||
+          (keyIsLocal == isLocal && (key.empty() || gv->getName() < key))) {
+        key = gv->getName();
+        keyIsLocal = isLocal;
+      }
+    }
+
+    MD5 hash;
+    hash.update(key);
+    MD5::MD5Result result;
+    hash.final(result);
+    const unsigned fragment = (result[0] | (result[1] << 8)) % numFragments;
+    for (auto member = groups.member_begin(it); member != groups.member_end();
+         ++member)
+      fragmentOf[*member] = fragment;
+  }
+
+  for (unsigned i = 0; i < numFragments; ++i) {
+    ValueToValueMapTy vmap;
+    std::unique_ptr<Module> fragment(CloneModule(
+#if LDC_LLVM_VER >= 700
+        m,
+#else
+        &m,
+#endif
+        vmap, [&](const GlobalValue *gv) {
+          auto it = fragmentOf.find(gv);
+          return it != fragmentOf.end() && it->second == i;
+        }));
+    if (i != 0)
+      fragment->setModuleInlineAsm("");
+    callback(std::move(fragment));
+  }
+}
+
+/// Splits the optimized module into fragments, which are looked up in and
+/// added to the cache separately, and merges their object files.
+/// The symbols are assigned to the fragments by the hash of their names (see
+/// splitModuleByNameHash()), so that a change to one function usually only
+/// invalidates a single fragment.
+void writeObjectFileFragments(llvm::Module *m, const char *filename) {
+  IF_LOG Logger::println("Splitting module into %u fragments",
+                         cacheFragments.getValue());
+  LOG_SCOPE
+
+  std::vector<std::string> fragmentFiles;
+  auto writeFragment = [&](std::unique_ptr<llvm::Module> fragment) {
+    llvm::SmallString<128> fragmentFile(filename);
+    llvm::sys::path::replace_extension(
+        fragmentFile, llvm::Twine("fragment") +
+                          llvm::Twine(fragmentFiles.size()) + "." +
+                          global.obj_ext);
+
+    llvm::SmallString<32> fragmentHash;
+    cache::calculateModuleHash(fragment.get(), fragmentHash,
+                               /*isFragment=*/true);
+    if (!cache::cacheLookup(fragmentHash).empty()) {
+      cache::recoverObjectFile(fragmentHash, fragmentFile);
+    } else {
+      const auto start = std::chrono::steady_clock::now();
+      writeObjectFile(fragment.get(), fragmentFile.c_str());
+      cache::cacheObjectFile(fragmentFile, fragmentHash,
+                             millisecondsSince(start));
+    }
+    fragmentFiles.push_back(fragmentFile.str());
+  };
+
+  splitModuleByNameHash(*m, cacheFragments, writeFragment);
+
+  mergeObjectFiles(fragmentFiles, filename);
+
+  for (const auto &fragmentFile : fragmentFiles)
+    llvm::sys::fs::remove(fragmentFile);
+}
+
+/// Returns whether machine codegen for the module may be spread across
+/// additional threads.
+bool canCodegenConcurrently(llvm::Module *m) {
+  if (getComputeTargetType(m) != ComputeBackend::None)
+    return false;
+
+  // The logger isn't thread-safe, and optimization remarks are only collected
+  // for the main thread's context.
+  if (Logger::enabled())
+    return false;
+#if LDC_LLVM_VER >= 400
+  if (opts::saveOptimizationRecord.getNumOccurrences() > 0)
+    return false;
+#endif
+
+  return true;
+}
+
+/// Returns the number of partitions for concurrent machine codegen of a
+/// -singleobj module (-j=N), or 0 for codegen in a single thread.
+unsigned getNumCodegenPartitions(llvm::Module *m) {
+  if (!global.params.oneobj || !canCodegenConcurrently(m) ||
+      !canMergeObjectFiles())
+    return 0;
+
+  unsigned numPartitions = opts::codegenThreads;
+  if (numPartitions == 0)
+    numPartitions = std::thread::hardware_concurrency();
+  return numPartitions > 1 ? numPartitions : 0;
+}
+
+/// Splits the optimized module into partitions, runs machine codegen for them
+/// concurrently and merges their object files.
+/// Local symbols are kept in the same partition as their users, so that the
+/// partitions can be merged without renaming any symbols.
+void writeObjectFilePartitions(llvm::Module *m, const char *filename,
+                               unsigned numPartitions) {
+  // LLVM contexts must not be shared across threads, so the partitions are
+  // handed over to the codegen threads as bitcode.
+  std::vector<llvm::SmallVector<char, 0>> partitions;
+  llvm::SplitModule(llvm::CloneModule(
+#if LDC_LLVM_VER >= 700
+                        *m
+#else
+                        m
+#endif
+                        ),
+                    numPartitions,
+                    [&](std::unique_ptr<llvm::Module> partition) {
+                      partitions.emplace_back();
+                      ldc::BackendPool::serializeModule(*partition,
+                                                        partitions.back());
+                    },
+                    /*PreserveLocals=*/true);
+
+  std::vector<std::string> partitionFiles;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    llvm::SmallString<128> partitionFile(filename);
+    llvm::sys::path::replace_extension(
+        partitionFile, llvm::Twine("partition") + llvm::Twine(i) + "." +
+                           global.obj_ext);
+    partitionFiles.push_back(partitionFile.str());
+  }
+
+  // The codegen threads collect their diagnostics, which are reported by this
+  // thread after joining them, or as soon as one of them runs into a fatal
+  // error.
+  struct CodegenState {
+    std::mutex mutex;
+    std::condition_variable doneOrFailed;
+    size_t finished = 0;
+    std::vector<CollectedDiagnostics> failed;
+
+    static void onFatal(CollectedDiagnostics *diagnostics) {
+      auto state = static_cast<CodegenState *>(diagnostics->context);
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->failed.push_back(*diagnostics);
+      state->doneOrFailed.notify_all();
+      // The main thread reports the diagnostics and exits.
+      while (true)
+        state->doneOrFailed.wait(lock);
+    }
+  } state;
+  std::vector<CollectedDiagnostics> diagnostics(partitions.size());
+  for (auto &d : diagnostics) {
+    d.onFatal = &CodegenState::onFatal;
+    d.context = &state;
+  }
+
+  const llvm::TargetMachine &mainTargetMachine = *gTargetMachine;
+  const std::string moduleId = m->getModuleIdentifier();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < partitions.size(); ++i) {
+    threads.emplace_back([&, i] {
+      collectDiagnostics(&diagnostics[i]);
+      std::unique_ptr<llvm::TargetMachine> targetMachine(
+          cloneTargetMachine(mainTargetMachine));
+      gTargetMachine = targetMachine.get();
+
+      {
+        llvm::LLVMContext context;
+        const auto &bitcode = partitions[i];
+        std::unique_ptr<llvm::Module> partition =
+            ldc::BackendPool::materializeModule(
+                llvm::StringRef(bitcode.data(), bitcode.size()), moduleId,
+                context);
+        writeObjectFile(partition.get(), partitionFiles[i].c_str());
+      }
+
+      gTargetMachine = nullptr;
+      collectDiagnostics(nullptr);
+      std::lock_guard<std::mutex> lock(state.mutex);
+      ++state.finished;
+      state.doneOrFailed.notify_all();
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.doneOrFailed.wait(lock, [&] {
+      return !state.failed.empty() || state.finished == threads.size();
+    });
+    if (!state.failed.empty()) {
+      // A failed thread never finishes; exit with the others still running.
+      for (auto &d : state.failed)
+        reportCollectedDiagnostics(d);
+      fatal();
+    }
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &d : diagnostics)
+    reportCollectedDiagnostics(d);
+
+  mergeObjectFiles(partitionFiles, filename);
+
+  for (const auto &partitionFile : partitionFiles)
+    llvm::sys::fs::remove(partitionFile);
+}
+
+/// Returns whether the assembly file is to be generated in a separate thread,
+/// concurrently with the object file, i.e., with an effective -j > 1.
+bool shouldWriteAsmConcurrently(llvm::Module *m) {
+  unsigned numThreads = opts::codegenThreads;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  return numThreads > 1 && canCodegenConcurrently(m);
+}
+
+/// Runs machine codegen of the assembly file for a copy of a module in a
+/// separate thread, with its own LLVM context and target machine.
+/// The diagnostics of the thread are reported by join(), i.e., by the thread
+/// writing the module (see reportCollectedDiagnostics()).
+class AsmFileWriter {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable doneOrFailed;
+  bool done = false;
+  bool failed = false;
+  CollectedDiagnostics diagnostics = {};
+
+  static void onFatal(CollectedDiagnostics *diagnostics) {
+    auto writer = static_cast<AsmFileWriter *>(diagnostics->context);
+    std::unique_lock<std::mutex> lock(writer->mutex);
+    writer->failed = true;
+    writer->doneOrFailed.notify_all();
+    // The main thread reports the diagnostics and exits.
+    while (true)
+      writer->doneOrFailed.wait(lock);
+  }
+
+public:
+  bool started() const { return thread.joinable(); }
+
+  void start(llvm::Module *m, const std::string &spath) {
+    std::shared_ptr<llvm::SmallVector<char, 0>> bitcode =
+        std::make_shared<llvm::SmallVector<char, 0>>();
+    ldc::BackendPool::serializeModule(*m, *bitcode);
+
+    const llvm::TargetMachine *mainTargetMachine = gTargetMachine;
+    const std::string moduleId = m->getModuleIdentifier();
+    diagnostics.onFatal = &onFatal;
+    diagnostics.context = this;
+    thread = std::thread([=] {
+      collectDiagnostics(&diagnostics);
+      std::unique_ptr<llvm::TargetMachine> targetMachine(
+          cloneTargetMachine(*mainTargetMachine));
+      gTargetMachine = targetMachine.get();
+
+      {
+        llvm::LLVMContext context;
+        std::unique_ptr<llvm::Module> copy =
+            ldc::BackendPool::materializeModule(
+                llvm::StringRef(bitcode->data(), bitcode->size()), moduleId,
+                context);
+
+        std::error_code errinfo;
+        llvm::raw_fd_ostream out(spath.c_str(), errinfo,
+                                 llvm::sys::fs::F_None);
+        if (errinfo) {
+          error(Loc(), "cannot write asm: %s", errinfo.message().c_str());
+          fatal();
+        }
+        codegenModule(*targetMachine, *copy, out,
+                      llvm::TargetMachine::CGFT_AssemblyFile);
+      }
+
+      gTargetMachine = nullptr;
+      collectDiagnostics(nullptr);
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      doneOrFailed.notify_all();
+    });
+  }
+
+  void join() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      doneOrFailed.wait(lock, [this] { return done || failed; });
+      if (failed) {
+        reportCollectedDiagnostics(diagnostics);
+        fatal();
+      }
+    }
+    thread.join();
+    reportCollectedDiagnostics(diagnostics);
+  }
+};
+
 bool shouldAssembleExternally() {
   // There is no integrated assembler on AIX because XCOFF is not supported.
   // Starting with LLVM 3.5 the integrated assembler can be used with MinGW.
@@ -310,17 +796,14 @@ void writeModule(llvm::Module *m, const char *filename) {
   const bool assembleExternally = shouldAssembleExternally();
 
   // Use cached object code if possible.
-  // TODO: combine LDC's cache and LTO (the advantage is skipping the IR
-  // optimization).
-  const bool useIR2ObjCache = !opts::cacheDir.empty() && outputObj && !doLTO;
+  // With LTO, the cached "object" is the optimized bitcode (incl. the module
+  // summary for ThinLTO), so that a hit skips the IR optimization and bitcode
+  // writing.
+  const bool useIR2ObjCache = !cache::cacheLocation().empty() && outputObj;
   llvm::SmallString<32> moduleHash;
   if (useIR2ObjCache) {
-    llvm::SmallString<128> cacheDir(opts::cacheDir.c_str());
-    llvm::sys::fs::make_absolute(cacheDir);
-    opts::cacheDir = cacheDir.c_str();
-
     IF_LOG Logger::println("Use IR-to-Object cache in %s",
-                           opts::cacheDir.c_str());
+                           cache::cacheLocation().str().c_str());
     LOG_SCOPE
 
     cache::calculateModuleHash(m, moduleHash);
@@ -331,6 +814,9 @@ void writeModule(llvm::Module *m, const char *filename) {
     }
   }
 
+  // The time spent from here on is saved by a cache hit.
+  const auto codegenStart = std::chrono::steady_clock::now();
+
   // run optimizer
   ldc_optimize_module(m);
 
@@ -404,6 +890,11 @@ void writeModule(llvm::Module *m, const char *filename) {
     }
   }
 
+  if (emitBitcodeAsObjectFile && useIR2ObjCache) {
+    cache::cacheObjectFile(filename, moduleHash,
+                           millisecondsSince(codegenStart));
+  }
+
   // write LLVM IR
   if (global.params.output_ll) {
     const auto llpath = replaceExtensionWith(global.ll_ext);
@@ -420,6 +911,7 @@ void writeModule(llvm::Module *m, const char *filename) {
   }
 
   const bool writeObj = outputObj && !emitBitcodeAsObjectFile;
+  AsmFileWriter asmWriter;
   // write native assembly
   if (global.params.output_s || assembleExternally) {
     std::string spath;
@@ -432,8 +924,12 @@ void writeModule(llvm::Module *m, const char *filename) {
     }
 
     Logger::println("Writing asm to: %s\n", spath.c_str());
-    std::error_code errinfo;
-    {
+    if (writeObj && shouldWriteAsmConcurrently(m)) {
+      // Generate the assembly file while the object file is being generated
+      // below.
+      asmWriter.start(m, spath);
+    } else {
+      std::error_code errinfo;
       llvm::raw_fd_ostream out(spath.c_str(), errinfo, llvm::sys::fs::F_None);
       if (!errinfo)
       {
@@ -462,9 +958,25 @@ void writeModule(llvm::Module *m, const char *filename) {
   }
 
   if (writeObj) {
-    writeObjectFile(m, filename);
+    if (useIR2ObjCache && cacheFragments > 1 && canMergeObjectFiles()) {
+      writeObjectFileFragments(m, filename);
+    } else if (const unsigned numPartitions = getNumCodegenPartitions(m)) {
+      writeObjectFilePartitions(m, filename, numPartitions);
+    } else if (!useIR2ObjCache && useInMemoryObjectFiles()) {
+      // A cache store needs the object file on disk.
+      writeObjectFileInMemory(m, filename);
+    } else if (!useIR2ObjCache && useInMemoryArchiveMembers()) {
+      writeArchiveMemberInMemory(m, filename);
+    } else {
+      writeObjectFile(m, filename);
+    }
     if (useIR2ObjCache) {
-      cache::cacheObjectFile(filename, moduleHash);
+      cache::cacheObjectFile(filename, moduleHash,
+                             millisecondsSince(codegenStart));
     }
   }
+
+  if (asmWriter.started()) {
+    asmWriter.join();
+  }
 }
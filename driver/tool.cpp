@@ -45,8 +45,9 @@ static std::string findProgramByName(llvm::StringRef name) {
 
 //////////////////////////////////////////////////////////////////////////////
 
-std::string getProgram(const char *name, const llvm::cl::opt<std::string> *opt,
-                       const char *envVar) {
+std::string findProgram(const char *name,
+                        const llvm::cl::opt<std::string> *opt,
+                        const char *envVar) {
   std::string path;
   const char *prog = nullptr;
 
@@ -62,6 +63,12 @@ std::string getProgram(const char *name, const llvm::cl::opt<std::string> *opt,
     path = findProgramByName(name);
   }
 
+  return path;
+}
+
+std::string getProgram(const char *name, const llvm::cl::opt<std::string> *opt,
+                       const char *envVar) {
+  std::string path = findProgram(name, opt, envVar);
   if (path.empty()) {
     error(Loc(), "failed to locate %s", name);
     fatal();
@@ -72,14 +79,16 @@ std::string getProgram(const char *name, const llvm::cl::opt<std::string> *opt,
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::string getGcc() {
 #if defined(__FreeBSD__) && __FreeBSD__ >= 10
-  // Default compiler on FreeBSD 10 is clang
-  return getProgram("clang", &gcc, "CC");
+// Default compiler on FreeBSD 10 is clang
+static const char *const gccName = "clang";
 #else
-  return getProgram("gcc", &gcc, "CC");
+static const char *const gccName = "gcc";
 #endif
-}
+
+std::string getGcc() { return getProgram(gccName, &gcc, "CC"); }
+
+std::string findGcc() { return findProgram(gccName, &gcc, "CC"); }
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -24,11 +24,17 @@ extern llvm::cl::opt<std::string> linker;
 }
 
 std::string getGcc();
+/// Like getGcc(), but returns an empty string if there is none.
+std::string findGcc();
 void appendTargetArgsForGcc(std::vector<std::string> &args);
 
 std::string getProgram(const char *name,
                        const llvm::cl::opt<std::string> *opt = nullptr,
                        const char *envVar = nullptr);
+/// Like getProgram(), but returns an empty string if there is no such program.
+std::string findProgram(const char *name,
+                        const llvm::cl::opt<std::string> *opt = nullptr,
+                        const char *envVar = nullptr);
 
 void createDirectoryForFileOrFail(llvm::StringRef fileName);
 
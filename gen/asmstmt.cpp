@@ -12,6 +12,7 @@
 #include "dmd/scope.h"
 #include "dmd/declaration.h"
 #include "dmd/dsymbol.h"
+#include "dmd/root/rmem.h"
 #include "gen/dvalue.h"
 #include "gen/functions.h"
 #include "gen/irstate.h"
@@ -49,9 +50,35 @@ struct AsmArg {
   }
 };
 
+/// Allocates from the frontend's heap, i.e., from the GC heap with -lowmem,
+/// so that the GC sees the operand expressions, which may only be referenced
+/// from the AsmCode of their statement.
+template <typename T> struct FrontendAllocator {
+  typedef T value_type;
+
+  FrontendAllocator() = default;
+  template <typename U> FrontendAllocator(const FrontendAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(mem.xmalloc(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) { mem.xfree(p); }
+
+  template <typename U> bool operator==(const FrontendAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const FrontendAllocator<U> &) const {
+    return false;
+  }
+};
+
 struct AsmCode {
+  // Referenced by InlineAsmStatement::asmcode, see FrontendAllocator.
+  static void *operator new(size_t size) { return mem.xmalloc(size); }
+  static void operator delete(void *p) { mem.xfree(p); }
+
   std::string insnTemplate;
-  std::vector<AsmArg> args;
+  std::vector<AsmArg, FrontendAllocator<AsmArg>> args;
   std::vector<bool> regs;
   unsigned dollarLabel;
   int clobbersMemory;
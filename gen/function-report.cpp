@@ -0,0 +1,259 @@
+//===-- function-report.cpp -----------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gen/function-report.h"
+
+#include "dmd/declaration.h"
+#include "dmd/errors.h"
+#include "dmd/template.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cl = llvm::cl;
+
+static cl::opt<std::string> reportFile(
+    "function-report", cl::ZeroOrMore, cl::value_desc("filename"),
+    cl::desc("Write a report of the IR instruction counts, optimization time "
+             "and machine code size of each emitted function, aggregated by "
+             "template declaration ('-' for stdout)"));
+
+namespace {
+
+using Duration = std::chrono::steady_clock::duration;
+
+struct FunctionEntry {
+  std::string demangledName;
+  std::string templateInstance;    // empty if not instantiated
+  std::string templateDeclaration; // empty if not instantiated
+  uint64_t instructionsBefore = 0;
+  uint64_t instructionsAfter = 0;
+  Duration optimizationTime = Duration::zero();
+  uint64_t machineCodeSize = 0;
+};
+
+std::mutex mutex;
+llvm::StringMap<FunctionEntry> functions;
+
+// Drops the \1 prefix of names not to be mangled by LLVM.
+llvm::StringRef getSymbolName(llvm::StringRef name) {
+  return name.startswith("\1") ? name.drop_front() : name;
+}
+
+double toMilliseconds(Duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+struct Group {
+  llvm::StringRef templateDeclaration;
+  std::vector<const llvm::StringMapEntry<FunctionEntry> *> functions;
+  size_t numInstances = 0;
+  uint64_t instructionsBefore = 0;
+  uint64_t instructionsAfter = 0;
+  Duration optimizationTime = Duration::zero();
+  uint64_t machineCodeSize = 0;
+};
+
+const int costsWidth = 50;
+
+void printCostsHeader(llvm::raw_ostream &os) {
+  os << llvm::format("%12s %11s %11s %11s  ", "opt time ms", "code bytes",
+                     "IR before", "IR after");
+}
+
+void printCosts(llvm::raw_ostream &os, Duration optimizationTime,
+                uint64_t machineCodeSize, uint64_t instructionsBefore,
+                uint64_t instructionsAfter) {
+  os << llvm::format("%12.3f %11llu %11llu %11llu  ",
+                     toMilliseconds(optimizationTime),
+                     static_cast<unsigned long long>(machineCodeSize),
+                     static_cast<unsigned long long>(instructionsBefore),
+                     static_cast<unsigned long long>(instructionsAfter));
+}
+
+void printReport(llvm::raw_ostream &os) {
+  llvm::StringMap<Group> groupsByDeclaration;
+  for (const auto &entry : functions) {
+    const FunctionEntry &f = entry.getValue();
+    Group &g = groupsByDeclaration[f.templateDeclaration];
+    g.functions.push_back(&entry);
+    g.instructionsBefore += f.instructionsBefore;
+    g.instructionsAfter += f.instructionsAfter;
+    g.optimizationTime += f.optimizationTime;
+    g.machineCodeSize += f.machineCodeSize;
+  }
+
+  const auto byCost = [](const FunctionEntry &a, const FunctionEntry &b) {
+    if (a.optimizationTime != b.optimizationTime)
+      return a.optimizationTime > b.optimizationTime;
+    return a.machineCodeSize > b.machineCodeSize;
+  };
+
+  std::vector<Group *> groups;
+  for (auto &entry : groupsByDeclaration) {
+    Group &g = entry.getValue();
+    g.templateDeclaration = entry.getKey();
+    llvm::StringMap<bool> instances;
+    for (const auto *f : g.functions)
+      instances[f->getValue().templateInstance] = true;
+    g.numInstances = instances.size();
+    std::sort(g.functions.begin(), g.functions.end(),
+              [&](const llvm::StringMapEntry<FunctionEntry> *a,
+                  const llvm::StringMapEntry<FunctionEntry> *b) {
+                return byCost(a->getValue(), b->getValue());
+              });
+    groups.push_back(&g);
+  }
+  std::sort(groups.begin(), groups.end(), [](const Group *a, const Group *b) {
+    if (a->optimizationTime != b->optimizationTime)
+      return a->optimizationTime > b->optimizationTime;
+    return a->machineCodeSize > b->machineCodeSize;
+  });
+
+  const char *noTemplate = "(not instantiated from a template)";
+
+  os << "=== Function report: " << functions.size() << " functions ===\n\n"
+     << "Template declarations, sorted by optimization time:\n";
+  printCostsHeader(os);
+  os << llvm::format("%9s %9s  ", "instances", "functions") << "declaration\n";
+  for (const Group *g : groups) {
+    printCosts(os, g->optimizationTime, g->machineCodeSize,
+               g->instructionsBefore, g->instructionsAfter);
+    if (g->templateDeclaration.empty()) {
+      os << llvm::format("%9s %9llu  ", "-",
+                         static_cast<unsigned long long>(g->functions.size()))
+         << noTemplate << '\n';
+    } else {
+      os << llvm::format("%9llu %9llu  ",
+                         static_cast<unsigned long long>(g->numInstances),
+                         static_cast<unsigned long long>(g->functions.size()))
+         << g->templateDeclaration << '\n';
+    }
+  }
+
+  os << "\nFunctions, grouped by template declaration:\n";
+  printCostsHeader(os);
+  os << "function\n";
+  for (const Group *g : groups) {
+    os << '\n'
+       << (g->templateDeclaration.empty() ? llvm::StringRef(noTemplate)
+                                          : g->templateDeclaration)
+       << ":\n";
+    for (const auto *entry : g->functions) {
+      const FunctionEntry &f = entry->getValue();
+      printCosts(os, f.optimizationTime, f.machineCodeSize,
+                 f.instructionsBefore, f.instructionsAfter);
+      os << f.demangledName << '\n';
+      const std::string indent(costsWidth, ' ');
+      os << indent << "mangled:  " << entry->getKey() << '\n';
+      if (!f.templateInstance.empty())
+        os << indent << "instance: " << f.templateInstance << '\n';
+    }
+  }
+}
+
+} // anonymous namespace
+
+namespace functionreport {
+
+bool enabled() { return !reportFile.empty(); }
+
+void registerFunction(llvm::StringRef mangledName, FuncDeclaration *fd) {
+  FunctionEntry entry;
+  entry.demangledName = fd->toPrettyChars();
+  if (TemplateInstance *ti = fd->isInstantiated()) {
+    entry.templateInstance = ti->toPrettyChars();
+    entry.templateDeclaration =
+        ti->tempdecl ? ti->tempdecl->toPrettyChars() : ti->toChars();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  functions.insert({getSymbolName(mangledName), std::move(entry)});
+}
+
+void addInstructionCounts(const llvm::Module &m, bool optimized) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const llvm::Function &func : m) {
+    auto it = functions.find(getSymbolName(func.getName()));
+    if (it == functions.end())
+      continue;
+    uint64_t count = 0;
+    for (const llvm::BasicBlock &bb : func)
+      count += bb.size();
+    if (optimized)
+      it->getValue().instructionsAfter += count;
+    else
+      it->getValue().instructionsBefore += count;
+  }
+}
+
+void addOptimizationTime(llvm::StringRef mangledName, Duration duration) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = functions.find(getSymbolName(mangledName));
+  if (it != functions.end())
+    it->getValue().optimizationTime += duration;
+}
+
+void addMachineCodeSizes(llvm::MemoryBufferRef objectFile, char globalPrefix) {
+  auto objOrErr = llvm::object::ObjectFile::createObjectFile(objectFile);
+  if (!objOrErr) {
+    llvm::consumeError(objOrErr.takeError());
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto symbolSizes = llvm::object::computeSymbolSizes(**objOrErr);
+  for (const auto &symbolAndSize : symbolSizes) {
+    const llvm::object::SymbolRef &symbol = symbolAndSize.first;
+    auto typeOrErr = symbol.getType();
+    auto nameOrErr = symbol.getName();
+    if (!typeOrErr || !nameOrErr) {
+      llvm::consumeError(typeOrErr.takeError());
+      llvm::consumeError(nameOrErr.takeError());
+      continue;
+    }
+    if (*typeOrErr != llvm::object::SymbolRef::ST_Function)
+      continue;
+
+    llvm::StringRef name = *nameOrErr;
+    auto it = functions.find(name);
+    if (it == functions.end() && globalPrefix && name.startswith({&globalPrefix, 1}))
+      it = functions.find(name.drop_front());
+    if (it != functions.end())
+      it->getValue().machineCodeSize += symbolAndSize.second;
+  }
+}
+
+void writeReport() {
+  if (reportFile == "-") {
+    printReport(llvm::outs());
+    llvm::outs().flush();
+    return;
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(reportFile, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    error(Loc(), "Cannot open function report file %s: %s",
+          reportFile.c_str(), ec.message().c_str());
+    fatal();
+  }
+  printReport(os);
+}
+}
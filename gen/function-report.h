@@ -0,0 +1,52 @@
+//===-- gen/function-report.h - Per-function cost report --------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// -function-report=<file> lists each emitted D function with its originating
+// template instance, its IR instruction count before and after optimization,
+// the time spent in the per-function optimization passes and its final
+// machine code size, aggregated by template declaration.
+//
+// The functions are identified by their mangled names, so that the data can
+// be collected by the backend threads too.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include <chrono>
+
+class FuncDeclaration;
+namespace llvm {
+class MemoryBufferRef;
+class Module;
+}
+
+namespace functionreport {
+
+bool enabled();
+
+/// Registers a function whose body is emitted.
+void registerFunction(llvm::StringRef mangledName, FuncDeclaration *fd);
+
+/// Adds the IR instruction counts of the module's functions, before or after
+/// the module has been optimized.
+void addInstructionCounts(const llvm::Module &m, bool optimized);
+
+/// Adds the time spent in a per-function pass for the function.
+void addOptimizationTime(llvm::StringRef mangledName,
+                         std::chrono::steady_clock::duration duration);
+
+/// Adds the sizes of the function symbols defined in the object file.
+void addMachineCodeSizes(llvm::MemoryBufferRef objectFile,
+                         char globalPrefix);
+
+/// Writes the report to the -function-report file.
+void writeReport();
+}
@@ -31,6 +31,7 @@
 #include "gen/dynamiccompile.h"
 #include "gen/funcgenstate.h"
 #include "gen/function-inlining.h"
+#include "gen/function-report.h"
 #include "gen/inlineir.h"
 #include "gen/irstate.h"
 #include "gen/linkage.h"
@@ -1002,6 +1003,10 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
     return;
   }
 
+  if (functionreport::enabled()) {
+    functionreport::registerFunction(func->getName(), fd);
+  }
+
   SCOPE_EXIT {
     if (irFunc->isDynamicCompiled()) {
       defineDynamicCompiledFunction(gIR, irFunc);
@@ -20,7 +20,7 @@
 #include <cstdarg>
 
 IRState *gIR = nullptr;
-llvm::TargetMachine *gTargetMachine = nullptr;
+thread_local llvm::TargetMachine *gTargetMachine = nullptr;
 const llvm::DataLayout *gDataLayout = nullptr;
 TargetABI *gABI = nullptr;
 
@@ -41,7 +41,9 @@ struct TargetABI;
 class DComputeTarget;
 
 extern IRState *gIR;
-extern llvm::TargetMachine *gTargetMachine;
+// Thread-local, as each backend worker thread (see driver/backendpool.h)
+// uses its own TargetMachine.
+extern thread_local llvm::TargetMachine *gTargetMachine;
 extern const llvm::DataLayout *gDataLayout;
 extern TargetABI *gABI;
 
@@ -11,12 +11,14 @@
 
 #include "dmd/errors.h"
 #include "gen/cl_helpers.h"
+#include "gen/function-report.h"
 #include "gen/logger.h"
 #include "gen/passes/Passes.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/cl_options_sanitizers.h"
 #include "driver/targetmachine.h"
+#include "driver/timetrace.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
@@ -36,7 +38,7 @@
 #include "llvm/Analysis/InlineCost.h"
 #endif
 
-extern llvm::TargetMachine *gTargetMachine;
+extern thread_local llvm::TargetMachine *gTargetMachine;
 using namespace llvm;
 
 static cl::opt<signed char> optimizeLevel(
@@ -338,13 +340,30 @@ static void addOptimizationPasses(legacy::PassManagerBase &mpm,
   builder.populateModulePassManager(mpm);
 }
 
+namespace {
+// Times each run of the added passes for -ftime-trace and -function-report.
+template <class PassManager> class TimedPassManager : public PassManager {
+public:
+  using PassManager::PassManager;
+
+  void add(Pass *pass) override {
+    const auto markers = createPassTimingMarkers(pass);
+    if (markers.first)
+      PassManager::add(markers.first);
+    PassManager::add(pass);
+    if (markers.second)
+      PassManager::add(markers.second);
+  }
+};
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // This function runs optimization passes based on command line arguments.
 // Returns true if any optimization passes were invoked.
 bool ldc_optimize_module(llvm::Module *M) {
   // Create a PassManager to hold and optimize the collection of
   // per-module passes we are about to build.
-  legacy::PassManager mpm;
+  TimedPassManager<legacy::PassManager> mpm;
 
   // Dont optimise spirv modules because turning GEPs into extracts triggers
   // asserts in the IR -> SPIR-V translation pass. SPIRV doesn't have a target
@@ -376,7 +395,7 @@ bool ldc_optimize_module(llvm::Module *M) {
       gTargetMachine->getTargetIRAnalysis()));
 
   // Also set up a manager for the per-function passes.
-  legacy::FunctionPassManager fpm(M);
+  TimedPassManager<legacy::FunctionPassManager> fpm(M);
 
   // Add internal analysis passes from the target machine.
   fpm.add(createTargetTransformInfoWrapperPass(
@@ -390,6 +409,12 @@ bool ldc_optimize_module(llvm::Module *M) {
 
   addOptimizationPasses(mpm, fpm, optLevel(), sizeLevel());
 
+  TimeTraceScope timeScope("Optimize module", M->getModuleIdentifier().c_str());
+
+  if (functionreport::enabled()) {
+    functionreport::addInstructionCounts(*M, /*optimized=*/false);
+  }
+
   // Run per-function passes.
   fpm.doInitialization();
   for (auto &F : *M) {
@@ -400,6 +425,10 @@ bool ldc_optimize_module(llvm::Module *M) {
   // Run per-module passes.
   mpm.run(*M);
 
+  if (functionreport::enabled()) {
+    functionreport::addInstructionCounts(*M, /*optimized=*/true);
+  }
+
   // Verify the resulting module.
   if (!noVerify) {
     verifyModule(M);